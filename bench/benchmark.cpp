@@ -0,0 +1,162 @@
+// Headless scene benchmark. Runs every scene at each particle count and
+// thread count, then prints one JSON document with throughput, the per-phase
+// breakdown and scaling efficiency against the first thread count.
+//
+//   particle_bench [--scenes fill,galton] [--counts 5000,20000] [--threads 1,2,4]
+//                  [--warmup 60] [--frames 300] [--seed 1] [--out result.json]
+//
+// Thread count 0 runs everything inline on the main thread. Built with
+// PARTICLE_ALLOC_TRACKING, each result also gets the heap allocations per
+// timed frame.
+
+// The per-phase breakdown needs the profiler timers
+#ifndef PARTICLE_PROFILING
+#define PARTICLE_PROFILING
+#endif
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench/scenes.hpp"
+#include "utils/profiler.hpp"
+#include "utils/alloc_tracker.hpp"
+
+struct BenchResult {
+    std::string               scene;
+    int                       requested   = 0;
+    int                       num_objects = 0;
+    int                       threads     = 0;
+    double                    seconds     = 0.0;
+    double                    throughput  = 0.0; // particle-substeps per second
+    double                    efficiency  = 1.0;
+    double                    allocations = -1.0; // per frame, negative without tracking
+    std::vector<PhaseSummary> phases;
+};
+
+static std::vector<std::string> splitList(const char* arg) {
+    std::vector<std::string> items;
+    std::stringstream stream(arg);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+static std::vector<int> splitInts(const char* arg) {
+    std::vector<int> values;
+    for (const std::string& item : splitList(arg)) values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+static BenchResult runScene(const std::string& name, int count, int threads, int warmup, int frames, uint64_t seed) {
+    Threader threader(threads);
+    Scene scene = makeScene(name, count, seed, threader);
+    Solver& solver = *scene.solver;
+
+    for (int f = 0; f < warmup; f++) solver.update();
+    Profiler::get().reset();
+    AllocTracker::get().enabled = true;
+
+    long long substeps = 0, allocations = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        solver.update();
+        substeps += static_cast<long long>(solver.objects.size()) * static_cast<int>(solver.substeps);
+        Profiler::get().endFrame();
+        ALLOC_FRAME();
+        allocations += AllocTracker::get().frame_count;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    AllocTracker::get().enabled = false;
+
+    BenchResult result;
+    result.scene       = name;
+    result.requested   = count;
+    result.num_objects = scene.num_objects;
+    result.threads     = threads;
+    result.seconds     = elapsed.count();
+    result.throughput  = substeps / elapsed.count();
+    result.phases      = Profiler::get().summary();
+#ifdef PARTICLE_ALLOC_TRACKING
+    result.allocations = static_cast<double>(allocations) / std::max(frames, 1);
+#endif
+    return result;
+}
+
+static void writeJSON(FILE* file, const std::vector<BenchResult>& results, int warmup, int frames, uint64_t seed) {
+    std::fprintf(file, "{\n\"warmup\": %d, \"frames\": %d, \"seed\": %llu,\n\"results\": [", warmup, frames,
+                 static_cast<unsigned long long>(seed));
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        std::fprintf(file, "%s\n  {\"scene\": \"%s\", \"requested\": %d, \"particles\": %d, \"threads\": %d, "
+                           "\"seconds\": %.4f, \"particle_substeps_per_s\": %.0f, \"efficiency\": %.3f, ",
+                     i ? "," : "", r.scene.c_str(), r.requested, r.num_objects, r.threads, r.seconds, r.throughput,
+                     r.efficiency);
+        if (r.allocations >= 0.0) std::fprintf(file, "\"allocations_per_frame\": %.2f, ", r.allocations);
+        std::fprintf(file, "\"phases\": {");
+        for (size_t p = 0; p < r.phases.size(); p++) {
+            const PhaseSummary& s = r.phases[p];
+            std::fprintf(file, "%s\"%s\": {\"mean_ms\": %.4f, \"p99_ms\": %.4f}", p ? ", " : "", s.name, s.mean, s.p99);
+        }
+        std::fprintf(file, "}}");
+    }
+    std::fprintf(file, "\n]}\n");
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> scenes  = scene_names;
+    std::vector<int>         counts  = {5000, 20000, 80000};
+    std::vector<int>         threads = {1, 2, 4};
+    int                      warmup  = 60;
+    int                      frames  = 300;
+    uint64_t                 seed    = 1;
+    const char*              out     = nullptr;
+
+    const int hardware = std::thread::hardware_concurrency();
+    if (hardware > 4) threads.push_back(hardware - 1);
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if      (!std::strcmp(argv[i], "--scenes"))  scenes  = splitList(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--counts"))  counts  = splitInts(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--threads")) threads = splitInts(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--warmup"))  warmup  = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--frames"))  frames  = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--seed"))    seed    = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--out"))     out     = argv[i + 1];
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (const std::string& scene : scenes) {
+        for (int count : counts) {
+            const size_t base = results.size();
+            for (int num_threads : threads) {
+                results.push_back(runScene(scene, count, num_threads, warmup, frames, seed));
+                BenchResult& r = results.back();
+                // Speedup over the first thread count, divided by the extra threads used
+                const BenchResult& first = results[base];
+                r.efficiency = (r.throughput / first.throughput) /
+                               (std::max(r.threads, 1) / static_cast<double>(std::max(first.threads, 1)));
+                std::fprintf(stderr, "%-9s %6d particles %2d threads %8.2f M particle-substeps/s\n", scene.c_str(),
+                             r.num_objects, r.threads, r.throughput / 1e6);
+            }
+        }
+    }
+
+    FILE* file = out ? std::fopen(out, "w") : stdout;
+    if (!file) {
+        std::fprintf(stderr, "cannot write %s\n", out);
+        return 1;
+    }
+    writeJSON(file, results, warmup, frames, seed);
+    if (out) std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,332 @@
+// Runs the same seeded scene through a reference and a candidate backend and
+// compares them every frame. Exits with 1 as soon as they diverge.
+//
+//   particle_diff [--scene galton] [--count 20000] [--frames 600] [--seed 1]
+//                 [--threads 4] [--collision slabs|gather|neighbours] [--sparse] [--multirate] [--adaptive]
+//                 [--exact] [--eps 0] [--cross-eps auto] [--energy-tol 0.4] [--overlap-tol 0.75] [--ks-tol 0.4]
+//                 [--border-tol 0.01] [--obstacle-tol 0.01] [--csv frames.csv]
+//
+// The reference is the scalar path: in-place slab collisions on a dense grid,
+// all on the calling thread.
+//
+// First the candidate backend runs on zero threads next to the reference on a
+// dilute gas of 1000 particles for 200 frames, where contacts are few and
+// mostly pairwise. Both start every frame from the reference's state, so only
+// one frame's response is compared and chaos has nothing to amplify. Backends
+// that keep the substep length (sparse grid, gather, neighbour lists) must stay
+// within 0.04 px: slabs resolve a pair sharing a cell twice, gather once,
+// which costs up to 0.022 px, while a gather response of 0.1 instead of 0.25
+// already reaches 0.07. Multi-rate and adaptive substeps move contacts to
+// other substeps and get 1.5 px, against a worst of 0.93 over seeds 1 to 11.
+//
+// Then the chosen scene runs with the candidate's threads. Trajectories of a
+// granular pile are chaotic, so only aggregates are compared: the energy lost
+// since the start, the solver's own overlap, border and obstacle diagnostics,
+// and the Kolmogorov-Smirnov distance between the speed and height
+// distributions. The default tolerances are the worst values seen with
+// 4-thread slabs, dense or sparse, on galton, fill and course (20000
+// particles, 600 frames, seeds 1 and 2), plus some margin: energy 0.16,
+// overlap 0.48, ks 0.35, border 0.0005. A settling pile drifts apart even when
+// the physics is the same, and fewer particles drift further. Below 20000 the
+// overlap, border and obstacle defaults are scaled by sqrt(20000 / count), and
+// ks grows as 0.15 + 0.25 * sqrt(20000 / count), which covers the worst seen at
+// 10000, 5000 and 2500: overlap 0.77, 1.04 and 1.82, ks 0.45, 0.57 and 0.61,
+// obstacles 0.005, 0.014 and 0.021. Energy does not follow the count: the
+// worst is 0.33, fill at 10000 on the sparse grid, where the reference pile
+// keeps breathing after the other has settled, so it stays at 0.4. Tolerances
+// passed explicitly are used as given. Gather, neighbour lists, multi-rate and adaptive substeps resolve
+// contacts differently and may exceed the aggregate tolerances on a settling
+// pile; the gas check is what covers their contacts.
+//
+// With --exact the reference is the candidate backend itself on zero threads,
+// and positions must match to within --eps. That only holds for backends
+// whose result does not depend on the order of work: gather and neighbour
+// lists. In-place slabs resolve pairs in a different order once
+// threaded.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bench/scenes.hpp"
+
+struct Backend {
+    int           threads        = 0;
+    CollisionMode collision_mode = CollisionMode::Slabs;
+    bool          sparse_grid    = false;
+    bool          multirate      = false;
+    bool          adaptive       = false;
+
+    void apply(Solver& solver) const {
+        solver.collision_mode    = collision_mode;
+        solver.sparse_grid       = sparse_grid;
+        solver.multirate         = multirate;
+        solver.adaptive_substeps = adaptive;
+        solver.diagnostics.enabled  = true;
+        solver.diagnostics.interval = 1;
+        solver.updateGrid();
+    }
+
+    std::string describe() const {
+        static const char* collisions[] = {"slabs", "gather", "neighbours"};
+        std::string text = std::string(collisions[static_cast<int>(collision_mode)]) + ", " + std::to_string(threads) + " threads";
+        if (sparse_grid) text += ", sparse grid";
+        if (multirate)   text += ", multi-rate";
+        if (adaptive)    text += ", adaptive substeps";
+        return text;
+    }
+};
+
+struct FrameMetrics {
+    double             energy       = 0.0; // kinetic plus potential in the gravity field
+    double             kinetic      = 0.0;
+    double             penetration  = 0.0; // summed overlap of penetrating pairs per particle
+    DiagnosticsReport  diagnostics;
+    std::vector<float> speeds;
+    std::vector<float> heights;
+};
+
+static FrameMetrics measure(Solver& solver) {
+    FrameMetrics metrics;
+    for (const Particle& obj : solver.objects) {
+        if (!obj.alive) continue;
+        const sf::Vector2f vel = obj.getVelocity() / (solver.substep_dt * obj.stride);
+        const float speed_sq = vel.x * vel.x + vel.y * vel.y;
+        metrics.kinetic += obj.mass * 0.5 * speed_sq;
+        metrics.energy  -= obj.mass * (solver.gravity.x * obj.position.x + solver.gravity.y * obj.position.y);
+        metrics.speeds.push_back(std::sqrt(speed_sq));
+        metrics.heights.push_back(obj.position.y);
+    }
+    metrics.energy     += metrics.kinetic;
+    metrics.diagnostics = solver.diagnostics.last;
+    if (!metrics.speeds.empty()) {
+        metrics.penetration = static_cast<double>(metrics.diagnostics.mean_overlap) *
+                              metrics.diagnostics.penetrating_pairs / metrics.speeds.size();
+    }
+    std::sort(metrics.speeds.begin(), metrics.speeds.end());
+    std::sort(metrics.heights.begin(), metrics.heights.end());
+    return metrics;
+}
+
+// Largest gap between the empirical CDFs of two sorted samples
+static double ksDistance(const std::vector<float>& a, const std::vector<float>& b) {
+    if (a.empty() || b.empty()) return a.size() == b.size() ? 0.0 : 1.0;
+    size_t i = 0, j = 0;
+    double distance = 0.0;
+    while (i < a.size() && j < b.size()) {
+        const float value = std::min(a[i], b[j]);
+        while (i < a.size() && a[i] <= value) i++;
+        while (j < b.size() && b[j] <= value) j++;
+        distance = std::max(distance, std::abs(static_cast<double>(i) / a.size() - static_cast<double>(j) / b.size()));
+    }
+    return distance;
+}
+
+static double maxPositionError(const Solver& reference, const Solver& candidate) {
+    if (reference.objects.size() != candidate.objects.size()) return INFINITY;
+    double error = 0.0;
+    for (size_t i = 0; i < reference.objects.size(); i++) {
+        const sf::Vector2f v = reference.objects[i].position - candidate.objects[i].position;
+        error = std::max(error, static_cast<double>(std::max(std::abs(v.x), std::abs(v.y))));
+    }
+    return error;
+}
+
+// Worst one-frame position error of the backend on zero threads against the
+// reference on the gas scene. Every frame starts from the reference's state
+static double gasError(Backend backend, uint64_t seed) {
+    backend.threads = 0;
+    Threader reference_threader(0);
+    Threader candidate_threader(0);
+    Scene reference_scene = makeScene("gas", 1000, seed, reference_threader);
+    Scene candidate_scene = makeScene("gas", 1000, seed, candidate_threader);
+    Solver& ref = *reference_scene.solver;
+    Solver& cand = *candidate_scene.solver;
+    Backend().apply(ref);
+    backend.apply(cand);
+
+    double worst = 0.0;
+    for (int frame = 1; frame <= 200; frame++) {
+        for (size_t i = 0; i < ref.objects.size(); i++) {
+            const Particle& obj = ref.objects[i];
+            cand.objects[i].position = obj.position;
+            cand.setObjectVelocity(cand.objects[i], obj.getVelocity() / (ref.substep_dt * obj.stride));
+        }
+        cand.updateGrid();
+        ref.update();
+        cand.update();
+        worst = std::max(worst, maxPositionError(ref, cand));
+    }
+    return worst;
+}
+
+int main(int argc, char** argv) {
+    std::string scene_name   = "galton";
+    int         count        = 20000;
+    int         frames       = 600;
+    uint64_t    seed         = 1;
+    Backend     candidate;
+    Backend     reference;
+    bool        exact        = false;
+    double      eps          = 0.0;
+    // Negative until given; the defaults are picked once the scene is built
+    double      cross_eps    = -1.0; // px on the gas check
+    double      energy_tol   = 0.4;  // relative to the reference's loss, or its kinetic energy if larger
+    double      overlap_tol  = -1.0; // relative, on top of a 0.001 floor
+    double      ks_tol       = -1.0; // of speeds and heights, see the header
+    double      border_tol   = -1.0; // extra violations, as a share of the particles
+    double      obstacle_tol = -1.0; // extra particles inside obstacles, as a share of the particles
+    const char* csv_path     = nullptr;
+
+    candidate.threads = 4;
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if      (!std::strcmp(argv[i], "--sparse"))       candidate.sparse_grid    = true;
+        else if (!std::strcmp(argv[i], "--multirate"))    candidate.multirate      = true;
+        else if (!std::strcmp(argv[i], "--adaptive"))     candidate.adaptive       = true;
+        else if (!std::strcmp(argv[i], "--exact"))        exact                    = true;
+        else if (!has_value) {
+            std::fprintf(stderr, "missing value for %s\n", argv[i]);
+            return 2;
+        }
+        else if (!std::strcmp(argv[i], "--scene"))        scene_name               = argv[++i];
+        else if (!std::strcmp(argv[i], "--count"))        count                    = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--frames"))       frames                   = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed"))         seed                     = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--threads"))      candidate.threads        = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--collision")) {
+            const char* mode = argv[++i];
+            if      (!std::strcmp(mode, "slabs"))      candidate.collision_mode = CollisionMode::Slabs;
+            else if (!std::strcmp(mode, "gather"))     candidate.collision_mode = CollisionMode::Gather;
+            else if (!std::strcmp(mode, "neighbours")) candidate.collision_mode = CollisionMode::NeighbourLists;
+            else {
+                std::fprintf(stderr, "unknown collision mode %s\n", mode);
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--eps"))          eps                      = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--cross-eps"))    cross_eps                = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--energy-tol"))   energy_tol               = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--overlap-tol"))  overlap_tol              = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--ks-tol"))       ks_tol                   = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--border-tol"))   border_tol               = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--obstacle-tol")) obstacle_tol             = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--csv"))          csv_path                 = argv[++i];
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (exact) {
+        reference         = candidate;
+        reference.threads = 0;
+        if (candidate.collision_mode == CollisionMode::Slabs && candidate.threads > 0) {
+            std::fprintf(stderr, "warning: threaded slabs are order dependent, exact positions will differ\n");
+        }
+    } else if (candidate.collision_mode != CollisionMode::Slabs || candidate.multirate || candidate.adaptive) {
+        std::fprintf(stderr, "warning: the default tolerances are tuned for slabs, this backend may exceed them on a "
+                             "settling pile; the gas check is the one that covers its contacts\n");
+    }
+
+    Threader reference_threader(reference.threads);
+    Threader candidate_threader(candidate.threads);
+    Scene reference_scene = makeScene(scene_name, count, seed, reference_threader);
+    Scene candidate_scene = makeScene(scene_name, count, seed, candidate_threader);
+    if (!reference_scene.solver) {
+        std::fprintf(stderr, "unknown scene %s\n", scene_name.c_str());
+        return 2;
+    }
+    Solver& ref = *reference_scene.solver;
+    Solver& cand = *candidate_scene.solver;
+    reference.apply(ref);
+    candidate.apply(cand);
+    std::fprintf(stderr, "%s, %d particles\nreference: %s\ncandidate: %s\n", scene_name.c_str(),
+                 reference_scene.num_objects, reference.describe().c_str(), candidate.describe().c_str());
+
+    if (!exact) {
+        if (cross_eps < 0.0) cross_eps = candidate.multirate || candidate.adaptive ? 1.5 : 0.04;
+        const double error = gasError(candidate, seed);
+        std::fprintf(stderr, "gas check on zero threads: worst position error %.4g px (eps %.4g)\n", error, cross_eps);
+        if (error > cross_eps) {
+            std::fprintf(stderr, "DIVERGED on the gas check\n");
+            return 1;
+        }
+    }
+    const double noise = std::max(1.0, std::sqrt(20000.0 / std::max(reference_scene.num_objects, 1)));
+    if (overlap_tol < 0.0)  overlap_tol  = 0.75 * noise;
+    if (ks_tol < 0.0)       ks_tol       = 0.15 + 0.25 * noise;
+    if (border_tol < 0.0)   border_tol   = 0.01 * noise;
+    if (obstacle_tol < 0.0) obstacle_tol = 0.01 * noise;
+
+    FILE* csv = csv_path ? std::fopen(csv_path, "w") : nullptr;
+    // The potential energy offset dwarfs any difference, so compare what was lost
+    const double start_energy = measure(ref).energy;
+
+    if (csv) std::fprintf(csv, "frame,energy_ref,energy_cand,max_overlap_ref,max_overlap_cand,mean_overlap_ref,mean_overlap_cand,"
+                          "pairs_ref,pairs_cand,border_ref,border_cand,obstacle_ref,obstacle_cand,ks_speed,ks_height,max_error\n");
+
+    double worst_energy = 0.0, worst_overlap = 0.0, worst_ks = 0.0, worst_border = 0.0, worst_obstacle = 0.0, worst_error = 0.0;
+    int    diverged_at  = -1;
+    for (int frame = 1; frame <= frames && diverged_at < 0; frame++) {
+        ref.update();
+        cand.update();
+        const FrameMetrics r = measure(ref);
+        const FrameMetrics c = measure(cand);
+
+        const double lost    = start_energy - r.energy;
+        const double energy  = std::abs(c.energy - r.energy) / std::max({std::abs(lost), r.kinetic, 1e-9});
+        const double overlap = std::abs(c.penetration - r.penetration) / std::max(r.penetration, 0.001);
+        const double ks      = std::max(ksDistance(r.speeds, c.speeds), ksDistance(r.heights, c.heights));
+        const double border  = static_cast<double>(c.diagnostics.border_violations - r.diagnostics.border_violations) /
+                               std::max<size_t>(r.speeds.size(), 1);
+        const double obstacle = static_cast<double>(c.diagnostics.obstacle_penetrations - r.diagnostics.obstacle_penetrations) /
+                                std::max<size_t>(r.speeds.size(), 1);
+        const double error   = exact ? maxPositionError(ref, cand) : 0.0;
+        worst_energy  = std::max(worst_energy, energy);
+        worst_overlap = std::max(worst_overlap, overlap);
+        worst_ks      = std::max(worst_ks, ks);
+        worst_border  = std::max(worst_border, border);
+        worst_obstacle = std::max(worst_obstacle, obstacle);
+        worst_error   = std::max(worst_error, error);
+
+        if (csv) {
+            const DiagnosticsReport& rd = r.diagnostics;
+            const DiagnosticsReport& cd = c.diagnostics;
+            std::fprintf(csv, "%d,%.6g,%.6g,%.5f,%.5f,%.5f,%.5f,%d,%d,%d,%d,%d,%d,%.5f,%.5f,%.6g\n", frame, r.energy, c.energy,
+                         rd.max_overlap, cd.max_overlap, rd.mean_overlap, cd.mean_overlap, rd.penetrating_pairs,
+                         cd.penetrating_pairs, rd.border_violations, cd.border_violations,
+                         rd.obstacle_penetrations, cd.obstacle_penetrations,
+                         ksDistance(r.speeds, c.speeds), ksDistance(r.heights, c.heights), error);
+        }
+        const bool failed = exact ? error > eps
+                                  : energy > energy_tol || overlap > overlap_tol || ks > ks_tol || border > border_tol ||
+                                    obstacle > obstacle_tol;
+        if (failed) {
+            diverged_at = frame;
+            std::fprintf(stderr, "frame %d: energy %.6g vs %.6g, max overlap %.4f vs %.4f, %d vs %d penetrating pairs, "
+                                 "%d vs %d border violations, %d vs %d in obstacles, ks %.4f",
+                         frame, r.energy, c.energy, r.diagnostics.max_overlap, c.diagnostics.max_overlap,
+                         r.diagnostics.penetrating_pairs, c.diagnostics.penetrating_pairs,
+                         r.diagnostics.border_violations, c.diagnostics.border_violations,
+                         r.diagnostics.obstacle_penetrations, c.diagnostics.obstacle_penetrations, ks);
+            if (exact) std::fprintf(stderr, ", position error %.6g", error);
+            std::fprintf(stderr, "\n");
+        }
+    }
+    if (csv) std::fclose(csv);
+
+    if (exact) std::fprintf(stderr, "worst position error %.6g (eps %.6g)\n", worst_error, eps);
+    else {
+        std::fprintf(stderr, "worst energy %.4f (tol %.4f), overlap %.4f (tol %.4f), ks %.4f (tol %.4f), border %.4f (tol %.4f), "
+                             "obstacles %.4f (tol %.4f)\n", worst_energy, energy_tol, worst_overlap, overlap_tol, worst_ks, ks_tol,
+                     worst_border, border_tol, worst_obstacle, obstacle_tol);
+    }
+    if (diverged_at >= 0) {
+        std::fprintf(stderr, "DIVERGED at frame %d\n", diverged_at);
+        return 1;
+    }
+    std::fprintf(stderr, "OK over %d frames\n", frames);
+    return 0;
+}
@@ -0,0 +1,253 @@
+// Solver kernel and thread pool microbenchmarks. Inputs are generated from
+// the seed, so two builds measure exactly the same work and their results can
+// be compared line by line.
+//
+//   particle_microbench [--filter collideCells] [--reps 15] [--seed 1]
+//                       [--out result.json] [--compare baseline.json] [--tolerance 0.1]
+//
+// Every benchmark reports the median and minimum time per operation over the
+// repetitions. With --compare, each result is matched by name against an
+// earlier output and the run fails if any got slower than the tolerance.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <SFML/Graphics.hpp>
+#include "solvers/solver_final.hpp"
+#include "thread.hpp"
+
+struct MicroResult {
+    std::string name;
+    long long   ops     = 0; // operations per repetition
+    double      median  = 0.0; // ns per operation
+    double      minimum = 0.0;
+};
+
+struct MicroBench {
+    std::string              filter;
+    int                      reps = 15;
+    uint64_t                 seed = 1;
+    std::vector<MicroResult> results;
+
+    bool wanted(const std::string& name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    // Runs prepare (untimed) then body once per repetition, after two warm-ups
+    void run(const std::string& name, long long ops, const std::function<void()>& prepare,
+             const std::function<void()>& body) {
+        std::vector<double> times;
+        for (int r = -2; r < reps; r++) {
+            prepare();
+            const auto start = std::chrono::steady_clock::now();
+            body();
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            if (r >= 0) times.push_back(elapsed.count() / ops);
+        }
+        std::sort(times.begin(), times.end());
+        results.push_back({name, ops, times[times.size() / 2], times.front()});
+        std::fprintf(stderr, "%-44s %12.2f ns/op (min %.2f)\n", name.c_str(), results.back().median,
+                     results.back().minimum);
+    }
+
+    float unit(uint64_t index) const {
+        return Emitter::hashUnit(seed, index);
+    }
+};
+
+// `count` particles spread uniformly over the window, with small random velocities
+static void scatterParticles(MicroBench& bench, Solver& solver, int count, float radius) {
+    for (int i = 0; i < count; i++) {
+        const sf::Vector2f pos = {radius + (solver.window_width - 2 * radius) * bench.unit(4 * i),
+                                  radius + (solver.window_height - 2 * radius) * bench.unit(4 * i + 1)};
+        Particle& obj = solver.addObject(pos, radius);
+        obj.setVelocity({bench.unit(4 * i + 2) - 0.5f, bench.unit(4 * i + 3) - 0.5f}, 1.0f);
+    }
+}
+
+// Cell against itself and its right neighbour, with `occupancy` particles per cell
+static void benchCollideCells(MicroBench& bench, int occupancy) {
+    const std::string name = "collideCells/occupancy=" + std::to_string(occupancy);
+    if (!bench.wanted(name)) return;
+    Threader threader(0);
+    const int cells = 64;
+    Solver solver(cells * 2.0f, cells * 2.0f, 1.0f, threader);
+    for (int x = 0; x < cells; x++) {
+        for (int y = 0; y < cells; y++) {
+            for (int k = 0; k < occupancy; k++) {
+                const uint64_t index = 2 * ((x * cells + y) * occupancy + k);
+                solver.addObject({(x + bench.unit(index)) * 2.0f, (y + bench.unit(index + 1)) * 2.0f}, 1.0f);
+            }
+        }
+    }
+    solver.updateGrid();
+    const std::vector<Particle> snapshot = solver.objects;
+    const long long pairs = 2LL * cells * cells * occupancy * occupancy;
+    bench.run(name, pairs, [&] { solver.objects = snapshot; }, [&] {
+        for (int x = 0; x < cells; x++) {
+            for (int y = 0; y < cells; y++) {
+                solver.collideCells(solver.cellAt(x, y), solver.cellAt(x, y));
+                solver.collideCells(solver.cellAt(x, y), solver.cellAt(x + 1, y));
+            }
+        }
+    });
+}
+
+static void benchUpdateGrid(MicroBench& bench, int count) {
+    const std::string name = "updateGrid/particles=" + std::to_string(count);
+    if (!bench.wanted(name)) return;
+    Threader threader(0);
+    Solver solver(1024.0f, 1024.0f, 1.0f, threader);
+    scatterParticles(bench, solver, count, 1.0f);
+    bench.run(name, count, [] {}, [&] { solver.updateGrid(); });
+}
+
+static void benchIntegration(MicroBench& bench, int count) {
+    const std::string name = "updateObjectsThreaded/particles=" + std::to_string(count);
+    if (!bench.wanted(name)) return;
+    Threader threader(0);
+    Solver solver(1024.0f, 1024.0f, 1.0f, threader);
+    scatterParticles(bench, solver, count, 1.0f);
+    const std::vector<Particle> snapshot = solver.objects;
+    const float dt = 1.0f / 480;
+    bench.run(name, count, [&] {
+        solver.objects = snapshot;
+        for (Particle& obj : solver.objects) obj.accelerate(solver.gravity);
+    }, [&] { solver.updateObjectsThreaded(0, count, dt); });
+}
+
+// Rotated boxes on a lattice, each surrounded by `count / boxes` particles
+static void benchBoxBounce(MicroBench& bench, int boxes, int count) {
+    const std::string name = "BoxBonce/boxes=" + std::to_string(boxes) + ",particles=" + std::to_string(count);
+    if (!bench.wanted(name)) return;
+    Threader threader(0);
+    Solver solver(1024.0f, 1024.0f, 2.0f, threader);
+    scatterParticles(bench, solver, count, 2.0f);
+    const int   side    = std::max(1, static_cast<int>(std::sqrt(boxes)));
+    const float spacing = solver.window_width / side;
+    for (int i = 0; i < boxes; i++) {
+        ObstacleBox& box = solver.addObstacleBox({spacing * 0.3f, spacing * 0.1f},
+                                                 {(i % side + 0.5f) * spacing, (i / side % side + 0.5f) * spacing});
+        box.rotation = 90.0f * bench.unit(4 * count + i);
+    }
+    solver.updateGrid();
+    const std::vector<Particle> snapshot = solver.objects;
+    bench.run(name, boxes, [&] { solver.objects = snapshot; }, [&] {
+        for (int i = 0; i < boxes; i++) solver.BoxBonce(i);
+    });
+}
+
+// About half of the particles overlap the dot
+static void benchDotBounce(MicroBench& bench, int count) {
+    const std::string name = "dotBounce/particles=" + std::to_string(count);
+    if (!bench.wanted(name)) return;
+    Threader threader(0);
+    Solver solver(1024.0f, 1024.0f, 1.0f, threader);
+    scatterParticles(bench, solver, count, 1.0f);
+    const std::vector<Particle> snapshot = solver.objects;
+    const sf::Vector2f center = {512.0f, 512.0f};
+    const float        radius = 1024.0f * std::sqrt(0.5f / M_PI);
+    bench.run(name, count, [&] { solver.objects = snapshot; }, [&] {
+        for (int i = 0; i < count; i++) solver.dotBounce(i, center, radius);
+    });
+}
+
+// Round trip of an empty parallel call: queueing, wake-up and the final wait
+static void benchParallel(MicroBench& bench, int num_threads) {
+    const std::string name = "parallel/threads=" + std::to_string(num_threads);
+    if (!bench.wanted(name)) return;
+    Threader threader(num_threads);
+    const int calls = 200;
+    bench.run(name, calls, [] {}, [&] {
+        for (int i = 0; i < calls; i++) threader.parallel(num_threads, [](int, int) {});
+    });
+}
+
+static void writeJSON(FILE* file, const MicroBench& bench) {
+    std::fprintf(file, "{\"reps\": %d, \"seed\": %llu, \"results\": [", bench.reps,
+                 static_cast<unsigned long long>(bench.seed));
+    for (size_t i = 0; i < bench.results.size(); i++) {
+        const MicroResult& r = bench.results[i];
+        std::fprintf(file, "%s\n  {\"name\": \"%s\", \"ops\": %lld, \"median_ns\": %.3f, \"min_ns\": %.3f}",
+                     i ? "," : "", r.name.c_str(), r.ops, r.median, r.minimum);
+    }
+    std::fprintf(file, "\n]}\n");
+}
+
+// Reads back the one-result-per-line format written above
+static std::vector<MicroResult> readJSON(const char* path) {
+    std::vector<MicroResult> results;
+    FILE* file = std::fopen(path, "r");
+    if (!file) return results;
+    char line[512], name[256];
+    while (std::fgets(line, sizeof(line), file)) {
+        MicroResult r;
+        if (std::sscanf(line, " {\"name\": \"%255[^\"]\", \"ops\": %lld, \"median_ns\": %lf, \"min_ns\": %lf",
+                        name, &r.ops, &r.median, &r.minimum) == 4) {
+            r.name = name;
+            results.push_back(r);
+        }
+    }
+    std::fclose(file);
+    return results;
+}
+
+// Prints the change against the baseline, returns the number of regressions
+static int compare(const MicroBench& bench, const char* path, double tolerance) {
+    const std::vector<MicroResult> baseline = readJSON(path);
+    if (baseline.empty()) {
+        std::fprintf(stderr, "no results in %s\n", path);
+        return 1;
+    }
+    int regressions = 0;
+    for (const MicroResult& r : bench.results) {
+        auto old = std::find_if(baseline.begin(), baseline.end(), [&](const MicroResult& b) { return b.name == r.name; });
+        if (old == baseline.end()) continue;
+        const double change = r.median / old->median - 1.0;
+        const bool   slower = change > tolerance;
+        regressions += slower;
+        std::fprintf(stderr, "%-44s %12.2f -> %10.2f ns/op %+7.1f%%%s\n", r.name.c_str(), old->median, r.median,
+                     change * 100.0, slower ? "  SLOWER" : "");
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    MicroBench  bench;
+    const char* out       = nullptr;
+    const char* baseline  = nullptr;
+    double      tolerance = 0.1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if      (!std::strcmp(argv[i], "--filter"))    bench.filter = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--reps"))      bench.reps   = std::max(1, std::atoi(argv[i + 1]));
+        else if (!std::strcmp(argv[i], "--seed"))      bench.seed   = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--out"))       out          = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--compare"))   baseline     = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--tolerance")) tolerance    = std::atof(argv[i + 1]);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    for (int occupancy : {1, 2, 4, 8, 16}) benchCollideCells(bench, occupancy);
+    for (int count : {10000, 100000}) benchUpdateGrid(bench, count);
+    for (int count : {10000, 100000}) benchIntegration(bench, count);
+    for (int boxes : {16, 256}) benchBoxBounce(bench, boxes, 50000);
+    for (int count : {10000, 100000}) benchDotBounce(bench, count);
+    for (int num_threads : {1, 2, 4, 8, 16, 32, 64}) benchParallel(bench, num_threads);
+
+    FILE* file = out ? std::fopen(out, "w") : stdout;
+    if (!file) {
+        std::fprintf(stderr, "cannot write %s\n", out);
+        return 1;
+    }
+    writeJSON(file, bench);
+    if (out) std::fclose(file);
+    return baseline && compare(bench, baseline, tolerance) > 0 ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "solvers/solver_final.hpp"
+#include "thread.hpp"
+
+// Headless versions of the presets. Particles start as a packed block with
+// seeded velocity jitter instead of being poured in over time, so the same
+// seed and count always give the same starting state. Worlds are grown to fit
+// the requested count, so scenes of different counts are never duplicates.
+struct Scene {
+    std::string             name;
+    std::unique_ptr<Solver> solver;
+    int                     num_objects = 0;
+};
+
+static void jitterVelocities(Solver& solver, uint64_t seed, float speed) {
+    const int count = solver.objects.size();
+    std::vector<float> units(2 * count);
+    CounterRNG::fill(seed, 0, units.data(), 2 * count);
+    for (int i = 0; i < count; i++) {
+        const sf::Vector2f vel = {units[2 * i] - 0.5f, units[2 * i + 1] - 0.5f};
+        solver.setObjectVelocity(solver.objects[i], vel * speed);
+    }
+}
+
+// Extra height a region `width` wide needs beyond `height` to hold `count`
+// particles in fillHexagonal's packing. Scenes grow their world downwards by
+// this much so every requested count is actually spawned
+static float extraHeight(int count, float width, float height, float radius) {
+    const float spacing    = 2.0f * radius;
+    const float row_height = spacing * 0.8660254f;
+    const int   per_row    = std::floor((width - spacing - radius) / spacing) + 1;
+    const int   rows       = (count + per_row - 1) / per_row;
+    // Half a row of slack so rounding never drops the last one
+    return std::max(0.0f, spacing + (rows - 0.5f) * row_height - height);
+}
+
+// main.cpp: an open box filling up
+static std::unique_ptr<Solver> buildFill(int count, Threader& threader) {
+    const float extra  = extraHeight(count, 1012.0f, 1012.0f, 2.0f);
+    auto        solver = std::make_unique<Solver>(1020, 1020 + extra, 2.0f, threader);
+    solver->gravity = {0.0f, 1000.0f};
+    solver->fillHexagonal({4.0f, 4.0f, solver->window_width - 8.0f, solver->window_height - 8.0f}, 2.0f, count);
+    return solver;
+}
+
+// galtonboard.cpp: pegs over 38 dividers, particles released above the pegs
+static std::unique_ptr<Solver> buildGalton(int count, Threader& threader) {
+    const float extra  = extraHeight(count, 1552.0f, 330.0f, 2.0f);
+    auto        solver = std::make_unique<Solver>(1560, 1380 + extra, 2.0f, threader);
+    solver->gravity   = {0.0f, 200.0f};
+    solver->dampening = 0.4f;
+    for (int i = 1; i <= 21; i++) {
+        float height = 340 + extra + i * 20;
+        float start  = (i % 2 == 1 ? 0 : 10);
+        for (float j = start; j <= solver->window_width; j += 20) solver->addObstacleDot(2.0f, {j, height});
+    }
+    for (float i = 40; i < solver->window_width; i += 40) {
+        solver->addObstacleBox({2.0f, 600.0f}, {i, solver->window_height - 300});
+    }
+    solver->fillHexagonal({4.0f, 4.0f, solver->window_width - 8.0f, 330.0f + extra}, 2.0f, count);
+    return solver;
+}
+
+// course.cpp: rows of moving platforms under a breakable lid
+static std::unique_ptr<Solver> buildCourse(int count, Threader& threader) {
+    const float extra  = extraHeight(count, 2330.0f, 86.0f, 4.0f);
+    auto        solver = std::make_unique<Solver>(2560, 1380 + extra, 4.0f, threader);
+    const float width = solver->window_width, height = solver->window_height;
+    solver->gravity = {0.0f, 1000.0f};
+    ObstacleBox& top = solver->addObstacleBox({width * 2, 10}, {0, 100 + extra});
+    top.breakable  = true;
+    top.durability = 600;
+    solver->addObstacleBox({10, height}, {width - 205, height / 2});
+    solver->addObstacleBox({width - 215, 10}, {(width - 205) / 2, height - 5});
+    for (int i = 0; i < 8; i++) {
+        int start = (i % 2 == 0 ? 40 : 200);
+        for (float j = start; j <= width - 200; j += 320) {
+            ObstacleBox& box = solver->addObstacleBox({160, 10}, {j, height + 30}, {j, 200 + extra});
+            box.cycle_speed = 10;
+            box.update_type = 2;
+            box.time        = i * 10.0 / 8;
+        }
+    }
+    solver->fillHexagonal({8.0f, 8.0f, width - 230.0f, 86.0f + extra}, 4.0f, count);
+    return solver;
+}
+
+// breakout2.cpp: a wall of small breakable bricks
+static std::unique_ptr<Solver> buildBreakout(int count, Threader& threader) {
+    const float extra  = extraHeight(count, 2544.0f, 370.0f, 4.0f);
+    auto        solver = std::make_unique<Solver>(2560, 1380 + extra, 4.0f, threader);
+    solver->gravity = {0.0f, 1000.0f};
+    for (int i = 0; i < 256; i++) {
+        for (int j = 0; j < 100; j++) {
+            ObstacleBox& box = solver->addObstacleBox({10, 10}, {5.0f + i * 10, 385.0f + extra + j * 10});
+            box.breakable  = true;
+            box.durability = box.total_dur = 50;
+        }
+    }
+    solver->fillHexagonal({8.0f, 8.0f, solver->window_width - 16.0f, 370.0f + extra}, 4.0f, count);
+    return solver;
+}
+
+// trail.cpp: a tilted ramp, a sweeping dot and a moving paddle
+static std::unique_ptr<Solver> buildTrail(int count, Threader& threader) {
+    const float extra  = extraHeight(count, 840.0f, 600.0f, 10.0f);
+    auto        solver = std::make_unique<Solver>(2560, 1380 + extra, 10.0f, threader);
+    solver->gravity = {0.0f, 1000.0f};
+    ObstacleBox& box = solver->addObstacleBox({800, 5000}, {800, 1400 + extra});
+    box.rotation = -60;
+    ObstacleDot& dot = solver->addObstacleDot(60, {1565.36f, 1380 + extra}, {0, 476.24f + extra});
+    dot.cycle_speed = 3;
+    ObstacleBox& box2 = solver->addObstacleBox({600, 30}, {2300, 1550 + extra}, {2300, -150 + extra});
+    box2.rotation    = -15;
+    box2.cycle_speed = 5;
+    box2.update_type = 2;
+    ObstacleBox& box3 = solver->addObstacleBox({200, 200}, {1000, 600 + extra});
+    box3.breakable = true;
+    solver->fillHexagonal({1700.0f, 20.0f, 840.0f, 600.0f + extra}, 10.0f, count);
+    return solver;
+}
+
+// A dilute gas with no gravity: particles start six radii apart, so contacts
+// stay rare and mostly pairwise, and backends can be compared position by
+// position
+static std::unique_ptr<Solver> buildGas(int count, Threader& threader) {
+    const float radius  = 4.0f;
+    const float spacing = 6.0f * radius;
+    const int   per_row = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count)))));
+    const float side    = per_row * spacing + 2.0f * spacing;
+    auto        solver  = std::make_unique<Solver>(side, side, radius, threader);
+    for (int i = 0; i < count; i++) {
+        solver->addObject({(1.5f + i % per_row) * spacing, (1.5f + i / per_row) * spacing}, radius);
+    }
+    return solver;
+}
+
+static const std::vector<std::string> scene_names = {"fill", "galton", "course", "breakout", "trail", "gas"};
+
+static Scene makeScene(const std::string& name, int count, uint64_t seed, Threader& threader) {
+    Scene scene;
+    scene.name = name;
+    if      (name == "fill")     scene.solver = buildFill(count, threader);
+    else if (name == "galton")   scene.solver = buildGalton(count, threader);
+    else if (name == "course")   scene.solver = buildCourse(count, threader);
+    else if (name == "breakout") scene.solver = buildBreakout(count, threader);
+    else if (name == "trail")    scene.solver = buildTrail(count, threader);
+    else if (name == "gas")      scene.solver = buildGas(count, threader);
+    else return scene;
+    scene.solver->seed = seed;
+    jitterVelocities(*scene.solver, seed, 50.0f);
+    scene.solver->updateGrid();
+    scene.num_objects = scene.solver->objects.size();
+    return scene;
+}
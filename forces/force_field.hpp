@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <iostream>
+#include <math.h>
+#include <SFML/Graphics.hpp>
+
+enum class FieldType { Attractor, Repeller, Vortex, Wind };
+
+struct ForceField {
+    sf::Vector2f position;
+    sf::Vector2f direction = {1.0f, 0.0f};
+    float radius = 120.0f;
+    float strength = 5.0f;
+    FieldType field_type = FieldType::Attractor;
+    bool enabled = true;
+
+    ForceField() = default;
+    ForceField(FieldType field_type_, sf::Vector2f position_, float radius_, float strength_)
+        : position{position_}
+        , radius{radius_}
+        , strength{strength_}
+        , field_type{field_type_}
+    {}
+
+    // Falls off linearly to zero at the edge of the field
+    sf::Vector2f accelerationAt(sf::Vector2f pos) const {
+        sf::Vector2f dir = position - pos;
+        float dist2 = dir.x * dir.x + dir.y * dir.y;
+        if (dist2 >= radius * radius) return {0.0f, 0.0f};
+        float falloff = strength * (radius - sqrt(dist2));
+        // No default, so -Wswitch flags a field type left unhandled
+        switch (field_type) {
+        case FieldType::Attractor:
+            return dir * falloff;
+        case FieldType::Repeller:
+            return -dir * falloff;
+        case FieldType::Vortex:
+            return sf::Vector2f{-dir.y, dir.x} * falloff;
+        case FieldType::Wind:
+            return direction * (falloff / radius);
+        }
+        return {0.0f, 0.0f};
+    }
+};
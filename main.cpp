@@ -5,13 +5,11 @@
 #include "solvers/solver_final.hpp"
 #include "renderers/renderer_fast.hpp"
 #include "thread.hpp"
+#include "utils/profiler.hpp"
+#include "utils/alloc_tracker.hpp"
 #include <chrono>
 #include <thread>
 
-float getRandom() {
-    return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-}
-
 static sf::Color getColor(float t) {
     const float r = sin(t);
     const float g = sin(t + 0.33f * 2.0f * M_PI);
@@ -31,11 +29,6 @@ int main() {
 
     const float        radius         = 2.0f;
     const int          max_objects    = 85000;
-    const sf::Vector2f spawn_position = {4.0f, 4.0f}; // 4, 4
-    const float        spawn_velocity = 600.0f; // 400
-    const int          max_spawner    = 24;  
-    int                num_spawner    = 24;
-    int                spawned_count  = 0;
 
     sf::ContextSettings settings;
     settings.antialiasingLevel = 1;
@@ -44,11 +37,12 @@ int main() {
     window.setFramerateLimit(frame_rate);
     
     Threader threadPool(10);
-    Solver solver(window_width, radius, threadPool);
+    Solver solver(window_width, window_height, radius, threadPool);
     Renderer renderer(window, threadPool, solver);
  
-    sf::Clock timer, fpstimer;
+    sf::Clock fpstimer;
     bool done = false;
+    bool show_overlay = false;
     int r, g, b;
     sf::Font arialFont;
     arialFont.loadFromFile("/Library/Fonts/Arial Unicode.ttf");
@@ -89,6 +83,25 @@ int main() {
     //     moving.rotation = 30.0f;
     // }
 
+    solver.reserve(max_objects);
+    renderer.reserve(max_objects);
+
+    // Start from a settled packing instead of pouring for over a thousand
+    // frames. The window holds about 73k at contact distance, so the packing
+    // stops there. Colours follow the order the pour would have laid rows down
+    const int num_objects = solver.fillHexagonal({4.0f, 4.0f, window_width - 8.0f, window_height - 8.0f}, radius, max_objects);
+    for (int i = 0; i < num_objects; i++) solver.objects[i].color = getColor(i / (24.0f * frame_rate));
+    solver.relax(8);
+
+    // Built once; the text is only rebuilt while the overlay is shown
+    sf::Text number;
+    number.setFont(arialFont);
+    number.setCharacterSize(24);
+    number.setFillColor(sf::Color::White);
+#ifdef PARTICLE_ALLOC_TRACKING
+    AllocTracker::get().enabled = true;
+#endif
+
     // Main loop
     while (window.isOpen()) {
         sf::Event event{};
@@ -96,28 +109,37 @@ int main() {
             if (event.type == sf::Event::Closed || sf::Keyboard::isKeyPressed(sf::Keyboard::Escape)) {
                 window.close();
             }
+            // F1 toggles the timing overlay, F2 writes the phase timings (PARTICLE_PROFILING
+            // builds), F3 traces the thread pool over the next 10 frames (PARTICLE_TRACING
+            // builds), F4 samples overlap diagnostics, F5 prints the last frame's
+            // allocations (PARTICLE_ALLOC_TRACKING builds)
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F1) show_overlay = !show_overlay;
+#ifdef PARTICLE_PROFILING
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F2) {
+                Profiler::get().writeCSV("profile.csv");
+                Profiler::get().writeJSON("profile.json");
+            }
+#endif
+#ifdef PARTICLE_TRACING
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                Tracer::get().capture(1, 10, "trace.json");
+            }
+#endif
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F4) {
+                solver.diagnostics.enabled = !solver.diagnostics.enabled;
+            }
+#ifdef PARTICLE_ALLOC_TRACKING
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F5) {
+                AllocTracker::get().print(stdout);
+            }
+#endif
         }
-        float time = timer.getElapsedTime().asSeconds();
         // if (time > 75 && !done) {
         //     done = true;
         //     for (Particle& obj : solver.objects) {
         //         std::cout << obj.position.x << ' ' << obj.position.y << std::endl;
         //     }
         // }
-        // Spawn particles
-        int num_objects = solver.objects.size();
-        if (num_objects < max_objects) {
-            sf::Color currentColor = getColor(time);
-            spawned_count++;
-            for (int i = 0; i < std::min(num_spawner, max_objects - num_objects); i++) {
-                auto& new_object = solver.addObject(spawn_position + sf::Vector2f{0.0f, i * 8.0f}, radius); // 8
-                // std::cin >> r >> g >> b;
-                // new_object.color = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
-                new_object.color = currentColor;
-                solver.setObjectVelocity(new_object, spawn_velocity * sf::Vector2f{0.8, 0.6});
-            }
-            if (spawned_count / 50 >= num_spawner && num_spawner < max_spawner) num_spawner++;
-        }
         // Detect mouse action
         if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
             float ratio = window_width / window.getSize().x; // Correct for scaled window
@@ -141,15 +163,28 @@ int main() {
         renderer.newRender();
         ms = 1.0 * fpstimer.getElapsedTime().asMicroseconds() / 1000;
         // Render performance
-        sf::Text number;
-        number.setFont(arialFont);
-        
-        number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
-        number.setCharacterSize(24);
-        number.setFillColor(sf::Color::White);
-        // window.draw(number);
+        if (show_overlay) {
+            std::string text = std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles\n";
+            if (solver.diagnostics.enabled) {
+                const DiagnosticsReport& report = solver.diagnostics.last;
+                char line[128];
+                std::snprintf(line, sizeof(line), "overlap max %.3f mean %.3f, %d pairs, %d outside border, "
+                              "%d in obstacles (max %.3f)\n", report.max_overlap, report.mean_overlap,
+                              report.penetrating_pairs, report.border_violations, report.obstacle_penetrations,
+                              report.max_obstacle_overlap);
+                text += line;
+            }
+#ifdef PARTICLE_PROFILING
+            text += Profiler::get().overlayText();
+#endif
+            number.setString(text);
+            window.draw(number);
+        }
         
         window.display();
+        PROFILE_FRAME();
+        TRACE_FRAME();
+        ALLOC_FRAME();
     }
     return 0;
 }
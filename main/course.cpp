@@ -29,9 +29,6 @@ int main() {
     const float        radius         = 4.0f;
     const int          max_objects    = 2400;
     const sf::Vector2f spawn_position = {24, 8};
-    const int          max_spawner    = 230;  
-    int                num_spawner    = 230;
-    int                spawned_count  = 0;
 
     sf::ContextSettings settings;
     settings.antialiasingLevel = 1;
@@ -43,7 +40,7 @@ int main() {
     Solver solver(window_width, window_height, radius, threadPool);
     Renderer renderer(window, threadPool, solver);
 
-    sf::Clock timer, fpstimer;
+    sf::Clock fpstimer;
     sf::Font arialFont;
     arialFont.loadFromFile("/Library/Fonts/Arial Unicode.ttf");
 
@@ -70,6 +67,23 @@ int main() {
         }
     }
 
+    Emitter& spawner = solver.addEmitter(spawn_position, {0.0f, 0.0f}, 230, frame_rate);
+    spawner.radius         = radius;
+    spawner.spacing        = {10.0f, 0.0f};
+    spawner.jitter         = {1.0f, 0.0f};
+    spawner.max_particles  = max_objects;
+    spawner.color_function = [](float time, int slot) { return getColor(time + slot * 0.02f); };
+
+    solver.reserve(max_objects);
+    renderer.reserve(max_objects);
+
+    // Built once, and refreshed twice a second since every sf::String allocates
+    sf::Text number;
+    number.setFont(arialFont);
+    number.setCharacterSize(24);
+    number.setFillColor(sf::Color::White);
+    int overlay_frame = 0;
+
     // Main loop
     while (window.isOpen()) {
         sf::Event event{};
@@ -78,19 +92,6 @@ int main() {
                 window.close();
             }
         }
-        float time = timer.getElapsedTime().asSeconds();
-        // Spawn particles
-        int num_objects = solver.objects.size();
-        if (num_objects < max_objects) {
-            spawned_count++;
-            for (int i = 0; i < std::min(num_spawner, max_objects - num_objects); i++) {
-                sf::Color currentColor = getColor(time + i * 0.02);
-                auto& new_object = solver.addObject(spawn_position + sf::Vector2f{i * 10.0f + getRandom(), 0}, radius);
-                new_object.color = currentColor;
-                // solver.setObjectVelocity(new_object, {800, 600});
-            }
-            // if (spawned_count / 50 >= num_spawner && num_spawner < max_spawner) num_spawner++;
-        }
         // Detect mouse action
         if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
             float ratio = window_width / window.getSize().x; // Correct for scaled window
@@ -109,12 +110,10 @@ int main() {
         renderer.updateTrailVA();
         renderer.newRender();
         // Render performance
-        sf::Text number;
-        number.setFont(arialFont);
         float ms = 1.0 * fpstimer.getElapsedTime().asMicroseconds() / 1000;
-        number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
-        number.setCharacterSize(24);
-        number.setFillColor(sf::Color::White);
+        if (overlay_frame++ % 30 == 0) {
+            number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
+        }
         window.draw(number);
         
         window.display();
@@ -0,0 +1,80 @@
+// Headless galton board sweep over dampening, gravity and peg spacing
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+#include <thread>
+#include <SFML/Graphics.hpp>
+#include "solvers/ensemble.hpp"
+#include "thread.hpp"
+
+struct BoardParams {
+    float dampening   = 0.4f;
+    float gravity     = 200.0f;
+    float peg_spacing = 20.0f;
+};
+
+constexpr int   window_width  = 1560;
+constexpr int   window_height = 1380;
+constexpr float divider_gap   = 40.0f;
+
+static void buildBoard(Solver& solver, const BoardParams& params, int max_objects) {
+    solver.dampening = params.dampening;
+    solver.gravity   = {0.0f, params.gravity};
+
+    for (int i = 1; i <= 21; i++) {
+        float height = 340 + i * params.peg_spacing;
+        float start  = (i % 2 == 1 ? 0 : params.peg_spacing * 0.5f);
+        for (float j = start; j <= window_width; j += params.peg_spacing) {
+            solver.addObstacleDot(2.0f, {j, height});
+        }
+    }
+    for (float i = divider_gap; i < window_width; i += divider_gap) {
+        solver.addObstacleBox({2.0f, 600.0f}, {i, window_height - 300});
+        solver.stats.bin_edges.push_back(i);
+    }
+    solver.stats.enabled    = true;
+    solver.stats.bin_region = {0.0f, window_height - 600.0f, window_width, 600.0f};
+
+    Emitter& spawner = solver.addEmitter({window_width / 2.0f - 60.5f, 4.0f}, {0.0f, 400.0f}, 16, 60);
+    spawner.spacing       = {8.0f, 0.0f};
+    spawner.jitter        = {1.0f, 0.0f};
+    spawner.max_particles = max_objects;
+}
+
+int main() {
+    const float radius      = 2.0f;
+    const int   max_objects = 4000;
+    const int   frames      = 1200;
+
+    std::vector<BoardParams> params;
+    for (float dampening : {0.3f, 0.4f, 0.6f}) {
+        for (float gravity : {150.0f, 200.0f, 300.0f}) {
+            for (float spacing : {16.0f, 20.0f, 24.0f}) {
+                params.push_back({dampening, gravity, spacing});
+            }
+        }
+    }
+
+    Threader threadPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    Ensemble ensemble(threadPool);
+    for (const BoardParams& p : params) {
+        buildBoard(ensemble.addRun(window_width, window_height, radius, max_objects), p, max_objects);
+    }
+
+    std::vector<std::vector<int>> bins(params.size());
+    sf::Clock timer;
+    ensemble.run(frames, [&](Solver& solver, int run) {
+        bins[run] = solver.stats.frame.bins;
+    });
+    fprintf(stderr, "%zu runs in %.1f s\n", params.size(), timer.getElapsedTime().asSeconds());
+
+    printf("run,dampening,gravity,peg_spacing");
+    for (int b = 0; b < static_cast<int>(bins[0].size()); b++) printf(",bin%d", b);
+    printf("\n");
+    for (int run = 0; run < static_cast<int>(params.size()); run++) {
+        printf("%d,%g,%g,%g", run, params[run].dampening, params[run].gravity, params[run].peg_spacing);
+        for (int count : bins[run]) printf(",%d", count);
+        printf("\n");
+    }
+    return 0;
+}
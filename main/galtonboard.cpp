@@ -5,6 +5,7 @@
 #include <SFML/Graphics.hpp>
 #include "solvers/solver_final.hpp"
 #include "renderers/renderer_fast.hpp"
+#include "utils/frame_budget.hpp"
 #include "thread.hpp"
 #include <chrono>
 #include <thread>
@@ -32,9 +33,7 @@ int main() {
     const sf::Vector2f spawn_position = {window_width / 2.0f - 60.5f, 4.0f}; // 4, 4
     const float        spawn_velocity = 400.0f; // 400
     const float        spawn_delay    = 0.05f;
-    const int          max_spawner    = 16; 
-    int                num_spawner    = 16;
-    int                spawned_count  = 0;
+    const int          num_spawner    = 16;
 
     sf::ContextSettings settings;
     settings.antialiasingLevel = 1;
@@ -45,8 +44,9 @@ int main() {
     Threader threadPool(10);
     Solver solver(window_width, window_height, radius, threadPool);
     Renderer renderer(window, threadPool, solver);
+    FrameBudget budget(solver, renderer, 1000.0f / frame_rate);
  
-    sf::Clock timer, fpstimer;
+    sf::Clock timer;
     bool done = false;
     int r, g, b;
     sf::Font arialFont;
@@ -61,7 +61,26 @@ int main() {
     }
     for (float i = 40; i < window_width; i += 40) {
         ObstacleBox& obs = solver.addObstacleBox({2.0f, 600.0f}, {i, window_height - 300});
+        solver.stats.bin_edges.push_back(i);
     }
+    solver.stats.enabled    = true;
+    solver.stats.bin_region = {0.0f, window_height - 600.0f, window_width, 600.0f};
+
+    Emitter& spawner = solver.addEmitter(spawn_position, spawn_velocity * sf::Vector2f{0.0, 1.0}, num_spawner, frame_rate);
+    spawner.spacing        = {8.0f, 0.0f};
+    spawner.jitter         = {1.0f, 0.0f};
+    spawner.max_particles  = max_objects;
+    spawner.color_function = [](float time, int) { return getColor(time); };
+
+    solver.reserve(max_objects);
+    renderer.reserve(max_objects);
+
+    // Built once, and refreshed twice a second since every sf::String allocates
+    sf::Text number;
+    number.setFont(arialFont);
+    number.setCharacterSize(24);
+    number.setFillColor(sf::Color::White);
+    int overlay_frame = 0;
 
     while (window.isOpen()) {
         sf::Event event{};
@@ -71,25 +90,10 @@ int main() {
             }
         }
         float time = timer.getElapsedTime().asSeconds();
-        // if (time > 75 && !done) {
-        //     done = true;
-        //     for (Particle& obj : solver.objects) {
-        //         std::cout << obj.position.x << ' ' << obj.position.y << std::endl;
-        //     }
-        // }
-        // Spawn particles
-        int num_objects = solver.objects.size();
-        if (num_objects < max_objects) {
-            sf::Color currentColor = getColor(time);
-            spawned_count++;
-            for (int i = 0; i < std::min(num_spawner, max_objects - num_objects); i++) {
-                auto& new_object = solver.addObject(spawn_position + sf::Vector2f{i * 8.0f + getRandom(), 0.0f}, radius); // 8
-                // std::cin >> r >> g >> b;
-                // new_object.color = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
-                new_object.color = currentColor;
-                solver.setObjectVelocity(new_object, spawn_velocity * sf::Vector2f{0.0, 1.0});
-            }
-            if (spawned_count / 50 >= num_spawner && num_spawner < max_spawner) num_spawner++;
+        if (time > 75 && !done) {
+            done = true;
+            for (int count : solver.stats.frame.bins) std::cout << count << ' ';
+            std::cout << std::endl;
         }
         // Detect mouse action
         if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
@@ -107,19 +111,18 @@ int main() {
         // if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) std::this_thread::sleep_for (std::chrono::milliseconds(60));
         // if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) std::this_thread::sleep_for (std::chrono::milliseconds(250));
 
-        fpstimer.restart();
+        budget.startUpdate();
         solver.update();
-        float ms = 1.0 * fpstimer.getElapsedTime().asMicroseconds() / 1000;
+        budget.startRender();
         window.clear(sf::Color::White);
         renderer.newRender();
-        ms = 1.0 * fpstimer.getElapsedTime().asMicroseconds() / 1000;
+        budget.endFrame();
+        float ms = budget.stats.update_ms + budget.stats.render_ms;
         // Render performance
-        sf::Text number;
-        number.setFont(arialFont);
-        
-        number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
-        number.setCharacterSize(24);
-        number.setFillColor(sf::Color::White);
+        if (overlay_frame++ % 30 == 0) {
+            number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles, " +
+                             budget.stats.level_name);
+        }
         window.draw(number);
         
         window.display();
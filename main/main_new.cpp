@@ -30,9 +30,6 @@ int main() {
     const int          max_objects    = 88888;
     const sf::Vector2f spawn_position = {4.0f, 4.0f};
     const float        spawn_velocity = 400.0f;
-    const int          max_spawner    = 24;  
-    int                num_spawner    = 24;
-    int                spawned_count  = 0;
 
     sf::ContextSettings settings;
     settings.antialiasingLevel = 1;
@@ -44,7 +41,7 @@ int main() {
     Solver solver(window_width, window_height, radius, threadPool);
     Renderer renderer(window, threadPool, solver);
 
-    sf::Clock timer, fpstimer;
+    sf::Clock fpstimer;
     bool done = false;
     int r, g, b;
     sf::Font arialFont;
@@ -86,6 +83,22 @@ int main() {
     }
     */
 
+    Emitter& spawner = solver.addEmitter(spawn_position, spawn_velocity * sf::Vector2f{0.8f, 0.6f}, 24, frame_rate);
+    spawner.radius        = radius;
+    spawner.spacing       = {0.0f, 8.0f};
+    spawner.max_particles = max_objects;
+    int colored = 0; // particles coloured from colors.txt so far, in spawn order
+
+    solver.reserve(max_objects);
+    renderer.reserve(max_objects);
+
+    // Built once, and refreshed twice a second since every sf::String allocates
+    sf::Text number;
+    number.setFont(arialFont);
+    number.setCharacterSize(24);
+    number.setFillColor(sf::Color::White);
+    int overlay_frame = 0;
+
     // Main loop
     while (window.isOpen()) {
         sf::Event event{};
@@ -94,27 +107,12 @@ int main() {
                 window.close();
             }
         }
-        float time = timer.getElapsedTime().asSeconds();
         // if (time > 90 && !done) {
         //     done = true;
         //     for (Particle& obj : solver.objects) {
         //         std::cout << obj.position.x << ' ' << obj.position.y << std::endl;
         //     }
         // }
-        // Spawn particles
-        int num_objects = solver.objects.size();
-        if (num_objects < max_objects) {
-            // sf::Color currentColor = getColor(time);
-            spawned_count++;
-            for (int i = 0; i < std::min(num_spawner, max_objects - num_objects); i++) {
-                auto& new_object = solver.addObject(spawn_position + sf::Vector2f{0.0f, i * 8.0f}, radius);
-                std::cin >> r >> g >> b;
-                new_object.color = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
-                // new_object.color = currentColor;
-                solver.setObjectVelocity(new_object, spawn_velocity * sf::Vector2f{0.8, 0.6});
-            }
-            // if (spawned_count / 50 >= num_spawner && num_spawner < max_spawner) num_spawner++;
-        }
         // Detect mouse action
         if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
             float ratio = window_width / window.getSize().x; // Correct for scaled window
@@ -136,15 +134,17 @@ int main() {
 
         fpstimer.restart();
         solver.update();
+        for (; colored < static_cast<int>(solver.objects.size()); colored++) {
+            std::cin >> r >> g >> b;
+            solver.objects[colored].color = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
+        }
         window.clear(sf::Color::White);
         renderer.newRender();
         // Render performance
-        sf::Text number;
-        number.setFont(arialFont);
         float ms = 1.0 * fpstimer.getElapsedTime().asMicroseconds() / 1000;
-        number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
-        number.setCharacterSize(24);
-        number.setFillColor(sf::Color::White);
+        if (overlay_frame++ % 30 == 0) {
+            number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
+        }
         window.draw(number);
         
         window.display();
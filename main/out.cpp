@@ -29,11 +29,8 @@ int main() {
 
     const float        radius         = 5.0f;
     const int          max_objects    = 25000;
-    const sf::Vector2f spawn_position = {600.0f, 4.0f}; // 4, 4
-    const float        spawn_velocity = 2000.0f; // 400
-    const int          max_spawner    = 24; 
-    int                num_spawner    = 24;
-    int                spawned_count  = 0;
+    const int          record_start   = 0;
+    const int          record_frames  = 6570; // every other frame
 
     sf::ContextSettings settings;
     settings.antialiasingLevel = 1;
@@ -46,7 +43,7 @@ int main() {
     Solver solver(window_width, window_height, radius, threadPool);
     Renderer renderer(window, threadPool, solver);
  
-    sf::Clock timer, fpstimer;
+    sf::Clock fpstimer;
     int r, g, b;
     sf::Font arialFont;
     arialFont.loadFromFile("/Library/Fonts/Arial Unicode.ttf");
@@ -65,9 +62,26 @@ int main() {
         {window_width - 400.0, -20.0});
     rdot.cycle_speed = 240.0 / 144.0;
 
-    std::vector<std::pair<int, int>> pos[7000];
+    std::vector<std::pair<int, int>> pos[record_frames + 1];
     int pos_counter = 0;
 
+    solver.reserve(max_objects);
+    renderer.reserve(max_objects);
+
+    // Same packing in out.cpp and in.cpp, so the recorded frames line up with
+    // the replay. It starts settled, so recording starts right away instead
+    // of after the 1350 frames the pour took
+    const int num_objects = solver.fillHexagonal({4.0f, 4.0f, window_width - 8.0f, window_height - 8.0f}, radius, max_objects);
+    for (int i = 0; i < num_objects; i++) solver.objects[i].color = getColor(i / (24.0f * frame_rate));
+    solver.relax(8);
+
+    // Built once, and refreshed twice a second since every sf::String allocates
+    sf::Text number;
+    number.setFont(arialFont);
+    number.setCharacterSize(24);
+    number.setFillColor(sf::Color::White);
+    int overlay_frame = 0;
+
     while (window.isOpen()) {
         sf::Event event{};
         while (window.pollEvent(event)) {
@@ -75,33 +89,18 @@ int main() {
                 window.close();
             }
         }
-        float time = timer.getElapsedTime().asSeconds();
 
-        if (frame >= 1350 && frame < 14490 && frame % 2 == 0) {
+        if (frame >= record_start && frame < record_start + 2 * record_frames && frame % 2 == 0) {
             pos_counter++;
             for (Particle& obj : solver.objects) {
                 pos[pos_counter].push_back(std::make_pair((int)obj.position.x, (int)obj.position.y));
             }
         }
         
-        if (frame > 14490) {
+        if (frame > record_start + 2 * record_frames) {
             window.close();
         }
         frame++;
-        // Spawn particles
-        int num_objects = solver.objects.size();
-        if (num_objects < max_objects) {
-            sf::Color currentColor = getColor(time);
-            spawned_count++;
-            for (int i = 0; i < std::min(num_spawner, max_objects - num_objects); i++) {
-                auto& new_object = solver.addObject(spawn_position + sf::Vector2f{i * 10.0f, 0.0f}, radius); // 8
-                // std::cin >> r >> g >> b;
-                // new_object.color = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
-                new_object.color = currentColor;
-                solver.setObjectVelocity(new_object, spawn_velocity * sf::Vector2f{0.4, 0.9});
-            }
-            if (spawned_count / 50 >= num_spawner && num_spawner < max_spawner) num_spawner++;
-        }
         // Detect mouse action
         if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
             float ratio = window_width / window.getSize().x; // Correct for scaled window
@@ -125,12 +124,9 @@ int main() {
         renderer.newRender();
         ms = 1.0 * fpstimer.getElapsedTime().asMicroseconds() / 1000;
         // Render performance
-        sf::Text number;
-        number.setFont(arialFont);
-        
-        number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
-        number.setCharacterSize(24);
-        number.setFillColor(sf::Color::White);
+        if (overlay_frame++ % 30 == 0) {
+            number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
+        }
         window.draw(number);
         
         window.display();
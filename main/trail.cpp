@@ -31,9 +31,6 @@ int main() {
     const int          max_objects    = 2000;
     const sf::Vector2f spawn_position = {4.0f, 20.0f};
     const float        spawn_velocity = 2000.0f;
-    const int          max_spawner    = 8;  
-    int                num_spawner    = 8;
-    int                spawned_count  = 0;
 
     sf::ContextSettings settings;
     settings.antialiasingLevel = 1;
@@ -45,7 +42,7 @@ int main() {
     Solver solver(window_width, window_height, radius, threadPool);
     Renderer renderer(window, threadPool, solver);
 
-    sf::Clock timer, fpstimer;
+    sf::Clock fpstimer;
     sf::Font arialFont;
     arialFont.loadFromFile("/Library/Fonts/Arial Unicode.ttf");
 
@@ -60,6 +57,22 @@ int main() {
     ObstacleBox& box3 = solver.addObstacleBox({200, 200}, {1000, 600});
     box3.breakable = true;
 
+    Emitter& spawner = solver.addEmitter(spawn_position, spawn_velocity * sf::Vector2f{1.0f, 0.0f}, 8, frame_rate);
+    spawner.radius         = radius;
+    spawner.spacing        = {0.0f, 35.0f};
+    spawner.max_particles  = max_objects;
+    spawner.color_function = [](float time, int) { return getColor(time); };
+
+    solver.reserve(max_objects);
+    renderer.reserve(max_objects);
+
+    // Built once, and refreshed twice a second since every sf::String allocates
+    sf::Text number;
+    number.setFont(arialFont);
+    number.setCharacterSize(24);
+    number.setFillColor(sf::Color::White);
+    int overlay_frame = 0;
+
     // Main loop
     while (window.isOpen()) {
         sf::Event event{};
@@ -68,19 +81,6 @@ int main() {
                 window.close();
             }
         }
-        float time = timer.getElapsedTime().asSeconds();
-        // Spawn particles
-        int num_objects = solver.objects.size();
-        if (num_objects < max_objects) {
-            sf::Color currentColor = getColor(time);
-            spawned_count++;
-            for (int i = 0; i < std::min(num_spawner, max_objects - num_objects); i++) {
-                auto& new_object = solver.addObject(spawn_position + sf::Vector2f{0.0f, i * 35.0f}, radius);
-                new_object.color = currentColor;
-                solver.setObjectVelocity(new_object, spawn_velocity * sf::Vector2f{1.0, 0.0});
-            }
-            // if (spawned_count / 50 >= num_spawner && num_spawner < max_spawner) num_spawner++;
-        }
         // Detect mouse action
         if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
             float ratio = window_width / window.getSize().x; // Correct for scaled window
@@ -106,12 +106,10 @@ int main() {
         renderer.updateTrailVA();
         renderer.newRender();
         // Render performance
-        sf::Text number;
-        number.setFont(arialFont);
         float ms = 1.0 * fpstimer.getElapsedTime().asMicroseconds() / 1000;
-        number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
-        number.setCharacterSize(24);
-        number.setFillColor(sf::Color::White);
+        if (overlay_frame++ % 30 == 0) {
+            number.setString(std::to_string(ms) + "ms, " + std::to_string(solver.objects.size()) + " particles");
+        }
         window.draw(number);
         
         window.display();
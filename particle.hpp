@@ -8,6 +8,12 @@ struct Particle {
     sf::Vector2f position_last;
     sf::Vector2f acceleration;
     float radius = 10.0f;
+    float mass   = 1.0f;
+    int   level  = 0;
+    float lifetime = -1.0f; // seconds left, negative lives forever
+    bool  alive  = true;
+    int   handle = 0;
+    int   stride = 1; // substeps per integration step under multi-rate stepping
     sf::Color color = sf::Color::Magenta;
     int gridx = 0, gridy = 0, id = 0;
 
@@ -44,7 +50,7 @@ struct Particle {
         position_last -= v * dt;
     }
 
-    sf::Vector2f getVelocity() {
+    sf::Vector2f getVelocity() const {
         return position - position_last;
     }
 };
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include "../solvers/solver_final.hpp"
 #include <SFML/Graphics.hpp>
 #include <string>
+#include <vector>
 #include "../thread.hpp"
+#include "../utils/profiler.hpp"
 
 class Renderer {
 public:
@@ -17,27 +19,58 @@ public:
         obj_texture.setSmooth(true);
     }
 
+    // Per-particle vertices live in vectors so they can be sized up front
+    void reserve(int max_objects) {
+        obj_va.reserve(4 * max_objects);
+        trail_va.reserve(4 * max_objects);
+    }
+
     void newRender() {
-        target.clear(sf::Color::Black);
         updateVA();
+        if (resolution >= 1.0f) {
+            drawScene(target);
+            return;
+        }
+
+        // Draw the same view into fewer pixels, then stretch it over the window
+        const sf::Vector2u size = {static_cast<unsigned>(target.getSize().x * resolution),
+                                   static_cast<unsigned>(target.getSize().y * resolution)};
+        if (low_res.getSize() != size) {
+            low_res.create(size.x, size.y);
+            low_res.setSmooth(true);
+        }
+        low_res.setView(target.getView());
+        drawScene(low_res);
+        low_res.display();
+
+        const sf::View view = target.getView();
+        sf::Sprite upscaled(low_res.getTexture());
+        upscaled.setScale(1.0f / resolution, 1.0f / resolution);
+        target.setView(target.getDefaultView());
+        target.draw(upscaled);
+        target.setView(view);
+    }
+
+    void drawScene(sf::RenderTarget& scene) {
+        scene.clear(sf::Color::Black);
+        scene.draw(box_va);
+        if (draw_trails) scene.draw(trail_va.data(), trail_va.size(), sf::Quads);
 
-        target.draw(box_va);
-        target.draw(trail_va);
-        
         sf::RenderStates states;
         states.texture = &obj_texture;
-        target.draw(dot_va, states);
-        target.draw(obj_va, states);
+        scene.draw(dot_va, states);
+        scene.draw(obj_va.data(), obj_va.size(), sf::Quads, states);
     }
 
     void updateVA() {
+        PROFILE_SCOPE("updateVA");
         obj_va.resize(solver.objects.size() * 4);
         const float tex_size = 1024.0f;
-        const float radius = solver.objects[0].radius;
         
         threader.parallel(solver.objects.size(), [&](int start, int end) {
             for (int i = start; i < end; i++) {
                 const Particle& obj = solver.objects[i];
+                const float radius = obj.radius;
                 const int id = i * 4;
                 obj_va[id    ].position = obj.position + sf::Vector2f{-radius, -radius};
                 obj_va[id + 1].position = obj.position + sf::Vector2f{ radius, -radius};
@@ -57,7 +90,7 @@ public:
 
                 
             }
-        });
+        }, "updateVA");
 
         dot_va.resize(solver.dot_obstacles.size() * 4);
         for (int i = 0; i < solver.dot_obstacles.size(); i++) {
@@ -103,12 +136,14 @@ public:
     }
 
     void updateTrailVA() {
+        PROFILE_SCOPE("updateTrailVA");
+        if (!draw_trails) return;
         trail_va.resize(solver.objects.size() * 4);
-        const float radius = solver.objects[0].radius * 0.6;
 
         threader.parallel(solver.objects.size(), [&](int start, int end) {
             for (int i = start; i < end; i++) {
                 const Particle& obj = solver.objects[i];
+                const float radius = obj.radius * 0.6;
                 const int id = i * 4;
                 sf::Vector2f disp = obj.position - obj.position_last;
                 sf::Vector2f back = disp * 20.0f;
@@ -128,17 +163,21 @@ public:
                 trail_va[id + 2].color = color;
                 trail_va[id + 3].color = color;
             }
-        });
+        }, "updateTrailVA");
     }
 
+    bool  draw_trails = true;
+    float resolution  = 1.0f; // fraction of the window size actually rendered
+
 private:
     sf::RenderWindow&        target;
     Solver&                  solver;
     Threader&          threader;
 
     sf::Texture     obj_texture;
-    sf::VertexArray obj_va{sf::Quads};
-    sf::VertexArray trail_va{sf::Quads};
+    std::vector<sf::Vertex> obj_va;
+    std::vector<sf::Vertex> trail_va;
     sf::VertexArray dot_va{sf::Quads};
     sf::VertexArray box_va{sf::Quads};
+    sf::RenderTexture low_res;
 };
\ No newline at end of file
@@ -0,0 +1,275 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <SFML/Graphics.hpp>
+#include "../particle.hpp"
+#include "../thread.hpp"
+#include "../utils/profiler.hpp"
+
+struct QuadNode {
+    sf::Vector2f center_of_mass;
+    float        mass        = 0.0f;
+    float        size        = 0.0f;
+    int          first_child = -1;
+    int          child_count = 0;
+    int          start = 0, end = 0;
+};
+
+// Long-range particle-particle forces. Particles are sorted along a Morton
+// curve, so every quadtree node owns a contiguous run of the sorted order and
+// the tree falls out of the sort without any pointer chasing.
+struct BarnesHut {
+    float                 theta     = 0.5f;  // opening angle
+    float                 strength  = 0.0f;  // > 0 attracts, < 0 repels, 0 disables
+    float                 softening = 4.0f;
+    int                   leaf_size = 8;
+
+    std::vector<uint32_t> codes, codes_tmp;
+    std::vector<int>      order, order_tmp;
+    std::vector<QuadNode> nodes;
+    sf::Vector2f          origin;
+    float                 extent = 1.0f;
+
+    // Work split for the pool: the sort and the bounds run over one block of
+    // the particles per task, and the tree below split_depth is built as one
+    // subtree per run of codes sharing their top 2 * split_depth bits
+    std::vector<int>                   block_counts; // 256 digits per block
+    std::vector<sf::Vector2f>          block_lo, block_hi;
+    std::vector<std::vector<QuadNode>> subtrees;
+    int                                split_depth = 0; // 0 builds the whole tree on the calling thread
+
+    static uint32_t spreadBits(uint32_t v) {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    static int blockStart(int num_objects, int block, int num_blocks) {
+        return static_cast<int64_t>(num_objects) * block / num_blocks;
+    }
+
+    // LSD radix sort. Each pass counts digits per block, turns the counts into
+    // each block's output offsets digit by digit, then scatters every block in
+    // order, so the passes stay stable
+    void sortCodes(Threader& threader) {
+        const int num_objects = codes.size();
+        const int num_blocks  = std::max(threader.num_threads, 1);
+        codes_tmp.resize(num_objects);
+        order_tmp.resize(num_objects);
+        block_counts.resize(256 * num_blocks);
+        for (int shift = 0; shift < 32; shift += 8) {
+            threader.parallel(num_blocks, [&](int first, int last) {
+                for (int b = first; b < last; b++) {
+                    int* count = &block_counts[256 * b];
+                    std::fill(count, count + 256, 0);
+                    const int end = blockStart(num_objects, b + 1, num_blocks);
+                    for (int i = blockStart(num_objects, b, num_blocks); i < end; i++) count[(codes[i] >> shift) & 0xff]++;
+                }
+            }, "morton count");
+            int offset = 0;
+            for (int digit = 0; digit < 256; digit++) {
+                for (int b = 0; b < num_blocks; b++) {
+                    const int count = block_counts[256 * b + digit];
+                    block_counts[256 * b + digit] = offset;
+                    offset += count;
+                }
+            }
+            threader.parallel(num_blocks, [&](int first, int last) {
+                for (int b = first; b < last; b++) {
+                    int* slots = &block_counts[256 * b];
+                    const int end = blockStart(num_objects, b + 1, num_blocks);
+                    for (int i = blockStart(num_objects, b, num_blocks); i < end; i++) {
+                        const int slot  = slots[(codes[i] >> shift) & 0xff]++;
+                        codes_tmp[slot] = codes[i];
+                        order_tmp[slot] = order[i];
+                    }
+                }
+            }, "morton scatter");
+            codes.swap(codes_tmp);
+            order.swap(order_tmp);
+        }
+    }
+
+    // Builds node `index` of `out` over the sorted run [start, end). The top
+    // levels (top set) stop at split_depth and take the prebuilt subtree instead
+    void buildNode(std::vector<QuadNode>& out, int index, int start, int end, int depth,
+                   const std::vector<Particle>& objects, bool top) {
+        if (top && depth == split_depth) {
+            spliceSubtree(index, start);
+            return;
+        }
+        out[index].start = start;
+        out[index].end   = end;
+        out[index].size  = extent / (1 << depth);
+
+        sf::Vector2f weighted = {0.0f, 0.0f};
+        float        mass     = 0.0f;
+        if (end - start <= leaf_size || depth == 16) {
+            for (int k = start; k < end; k++) {
+                const Particle& obj = objects[order[k]];
+                weighted += obj.position * obj.mass;
+                mass     += obj.mass;
+            }
+        } else {
+            // Children are the runs sharing the next two bits of the code
+            const int      shift  = 30 - 2 * depth;
+            const uint32_t prefix = codes[start] & ~((4u << shift) - 1);
+            int bounds[5] = {start, 0, 0, 0, end};
+            for (uint32_t q = 1; q < 4; q++) {
+                bounds[q] = std::lower_bound(codes.begin() + bounds[q - 1], codes.begin() + end,
+                                             prefix | (q << shift)) - codes.begin();
+            }
+            int child_count = 0;
+            for (int q = 0; q < 4; q++) child_count += bounds[q] < bounds[q + 1];
+
+            const int first_child = out.size();
+            out.resize(first_child + child_count);
+            out[index].first_child = first_child;
+            out[index].child_count = child_count;
+
+            int child = first_child;
+            for (int q = 0; q < 4; q++) {
+                if (bounds[q] == bounds[q + 1]) continue;
+                buildNode(out, child, bounds[q], bounds[q + 1], depth + 1, objects, top);
+                weighted += out[child].center_of_mass * out[child].mass;
+                mass     += out[child].mass;
+                child++;
+            }
+        }
+        out[index].mass           = mass;
+        out[index].center_of_mass = mass > 0.0f ? weighted / mass : weighted;
+    }
+
+    // Subtree roots sit at local index 0 and their descendants follow, so
+    // local index k >= 1 lands at base + k once appended
+    void spliceSubtree(int index, int start) {
+        const std::vector<QuadNode>& subtree = subtrees[codes[start] >> (32 - 2 * split_depth)];
+        const int base = nodes.size() - 1;
+        for (size_t k = 0; k < subtree.size(); k++) {
+            QuadNode node = subtree[k];
+            if (node.first_child >= 0) node.first_child += base;
+            if (k == 0) nodes[index] = node;
+            else        nodes.push_back(node);
+        }
+    }
+
+    void buildSubtrees(const std::vector<Particle>& objects, Threader& threader) {
+        const int num_runs = 1 << (2 * split_depth);
+        const int shift    = 32 - 2 * split_depth;
+        subtrees.resize(num_runs);
+        threader.parallel(num_runs, [&](int first, int last) {
+            for (int r = first; r < last; r++) {
+                std::vector<QuadNode>& subtree = subtrees[r];
+                subtree.clear();
+                const int start = std::lower_bound(codes.begin(), codes.end(), static_cast<uint32_t>(r) << shift) - codes.begin();
+                const int end   = r + 1 == num_runs ? static_cast<int>(codes.size()) :
+                                  std::lower_bound(codes.begin() + start, codes.end(), static_cast<uint32_t>(r + 1) << shift) - codes.begin();
+                if (start == end) continue;
+                subtree.emplace_back();
+                buildNode(subtree, 0, start, end, split_depth, objects, false);
+            }
+        }, "tree build");
+    }
+
+    void build(const std::vector<Particle>& objects, Threader& threader) {
+        const int num_objects = objects.size();
+        const int num_blocks  = std::max(threader.num_threads, 1);
+        block_lo.resize(num_blocks);
+        block_hi.resize(num_blocks);
+        threader.parallel(num_blocks, [&](int first, int last) {
+            for (int b = first; b < last; b++) {
+                const int start = blockStart(num_objects, b, num_blocks);
+                const int end   = blockStart(num_objects, b + 1, num_blocks);
+                sf::Vector2f lo = objects[start].position, hi = objects[start].position;
+                for (int i = start; i < end; i++) {
+                    const sf::Vector2f p = objects[i].position;
+                    lo.x = std::min(lo.x, p.x);
+                    lo.y = std::min(lo.y, p.y);
+                    hi.x = std::max(hi.x, p.x);
+                    hi.y = std::max(hi.y, p.y);
+                }
+                block_lo[b] = lo;
+                block_hi[b] = hi;
+            }
+        }, "morton bounds");
+        sf::Vector2f lo = block_lo[0], hi = block_hi[0];
+        for (int b = 1; b < num_blocks; b++) {
+            lo.x = std::min(lo.x, block_lo[b].x);
+            lo.y = std::min(lo.y, block_lo[b].y);
+            hi.x = std::max(hi.x, block_hi[b].x);
+            hi.y = std::max(hi.y, block_hi[b].y);
+        }
+        origin = lo;
+        extent = std::max(std::max(hi.x - lo.x, hi.y - lo.y), 1.0f);
+
+        codes.resize(num_objects);
+        order.resize(num_objects);
+        const float scale = 65535.0f / extent;
+        threader.parallel(num_objects, [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                const sf::Vector2f p = (objects[i].position - origin) * scale;
+                codes[i] = spreadBits(static_cast<uint32_t>(p.x)) | (spreadBits(static_cast<uint32_t>(p.y)) << 1);
+                order[i] = i;
+            }
+        });
+        sortCodes(threader);
+
+        // About eight subtrees per thread, so uneven ones still balance
+        split_depth = 0;
+        while (threader.num_threads > 1 && split_depth < 4 && (1 << (2 * split_depth)) < 8 * threader.num_threads) split_depth++;
+        if (split_depth > 0) buildSubtrees(objects, threader);
+
+        nodes.clear();
+        nodes.emplace_back();
+        buildNode(nodes, 0, 0, num_objects, 0, objects, split_depth > 0);
+    }
+
+    sf::Vector2f pull(sf::Vector2f from, sf::Vector2f to, float mass) const {
+        sf::Vector2f d = to - from;
+        float dist2    = d.x * d.x + d.y * d.y + softening * softening;
+        return d * (strength * mass / (dist2 * sqrt(dist2)));
+    }
+
+    sf::Vector2f accelerationAt(int obj_id, const std::vector<Particle>& objects) const {
+        const sf::Vector2f pos = objects[obj_id].position;
+        sf::Vector2f acc       = {0.0f, 0.0f};
+        int stack[128];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const QuadNode& node = nodes[stack[--top]];
+            if (node.first_child < 0) {
+                for (int k = node.start; k < node.end; k++) {
+                    if (order[k] == obj_id) continue;
+                    acc += pull(pos, objects[order[k]].position, objects[order[k]].mass);
+                }
+                continue;
+            }
+            sf::Vector2f d = node.center_of_mass - pos;
+            float dist2    = d.x * d.x + d.y * d.y;
+            if (node.size * node.size < theta * theta * dist2) {
+                acc += pull(pos, node.center_of_mass, node.mass);
+                continue;
+            }
+            for (int c = 0; c < node.child_count; c++) stack[top++] = node.first_child + c;
+        }
+        return acc;
+    }
+
+    void apply(std::vector<Particle>& objects, Threader& threader) {
+        if (strength == 0.0f || objects.size() < 2) return;
+        PROFILE_SCOPE("long range");
+        build(objects, threader);
+        // Walk in Morton order so neighbouring work items share tree paths
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int k = start; k < end; k++) {
+                objects[order[k]].accelerate(accelerationAt(order[k], objects));
+            }
+        });
+    }
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <SFML/Graphics.hpp>
+#include "../particle.hpp"
+
+// How far the constraints are from satisfied once a frame is done. Overlaps
+// are fractions of the contact distance, so 0.1 means two particles sit 10%
+// closer than their radii allow. Obstacle overlaps are depths inside the
+// obstacle as a fraction of the particle's radius
+struct DiagnosticsAccumulator {
+    double overlap_sum           = 0.0; // over penetrating pairs
+    float  max_overlap           = 0.0f;
+    int    penetrating_pairs     = 0;
+    int    border_violations     = 0;
+    float  max_obstacle_overlap  = 0.0f;
+    int    obstacle_penetrations = 0;
+
+    void reset() {
+        *this = DiagnosticsAccumulator{};
+    }
+
+    void merge(const DiagnosticsAccumulator& other) {
+        overlap_sum       += other.overlap_sum;
+        max_overlap        = std::max(max_overlap, other.max_overlap);
+        penetrating_pairs += other.penetrating_pairs;
+        border_violations += other.border_violations;
+        max_obstacle_overlap   = std::max(max_obstacle_overlap, other.max_obstacle_overlap);
+        obstacle_penetrations += other.obstacle_penetrations;
+    }
+};
+
+struct DiagnosticsReport {
+    int   frame                 = 0;
+    float max_overlap           = 0.0f;
+    float mean_overlap          = 0.0f;
+    int   penetrating_pairs     = 0;
+    int   border_violations     = 0; // particles left outside the border
+    float max_obstacle_overlap  = 0.0f;
+    int   obstacle_penetrations = 0; // particle-obstacle pairs past the tolerance
+};
+
+// Sampled every `interval` frames; each sample is one read-only pass over the
+// grid, split across the pool like the integration statistics
+struct SolverDiagnostics {
+    bool               enabled   = false;
+    int                interval  = 60;
+    float              tolerance = 0.01f; // overlap below this is contact, not penetration
+    int                frame     = 0;
+
+    DiagnosticsReport  last;
+    std::vector<DiagnosticsAccumulator> partials;
+    std::atomic<int>   next_partial{0};
+
+    bool due() {
+        return enabled && ++frame % std::max(interval, 1) == 0;
+    }
+
+    void begin(int max_tasks) {
+        partials.resize(max_tasks);
+        for (DiagnosticsAccumulator& partial : partials) partial.reset();
+        next_partial = 0;
+    }
+
+    DiagnosticsAccumulator& acquire() {
+        return partials[next_partial++];
+    }
+
+    void end() {
+        DiagnosticsAccumulator total;
+        for (int i = 0; i < next_partial; i++) total.merge(partials[i]);
+        last.frame             = frame;
+        last.max_overlap       = total.max_overlap;
+        last.mean_overlap      = total.penetrating_pairs ? total.overlap_sum / total.penetrating_pairs : 0.0f;
+        last.penetrating_pairs = total.penetrating_pairs;
+        last.border_violations = total.border_violations;
+        last.max_obstacle_overlap  = total.max_obstacle_overlap;
+        last.obstacle_penetrations = total.obstacle_penetrations;
+    }
+
+    void addPair(DiagnosticsAccumulator& acc, const Particle& obj_1, const Particle& obj_2) const {
+        const sf::Vector2f v = obj_1.position - obj_2.position;
+        const float dist_sq  = v.x * v.x + v.y * v.y;
+        const float min_dist = obj_1.radius + obj_2.radius;
+        if (dist_sq >= min_dist * min_dist) return;
+        const float overlap = 1.0f - std::sqrt(dist_sq) / min_dist;
+        if (overlap <= tolerance) return;
+        acc.overlap_sum += overlap;
+        acc.max_overlap  = std::max(acc.max_overlap, overlap);
+        acc.penetrating_pairs++;
+    }
+
+    // depth is how far the particle reaches into the obstacle
+    void addObstacle(DiagnosticsAccumulator& acc, const Particle& obj, float depth) const {
+        const float overlap = depth / obj.radius;
+        if (overlap <= tolerance) return;
+        acc.max_obstacle_overlap = std::max(acc.max_obstacle_overlap, overlap);
+        acc.obstacle_penetrations++;
+    }
+
+    // margin is how close to the edge the border lets a particle come
+    void addBorder(DiagnosticsAccumulator& acc, const Particle& obj, float width, float height, float margin) const {
+        const float slack = tolerance * obj.radius;
+        if (obj.position.x < margin - slack || obj.position.x > width  - margin + slack ||
+            obj.position.y < margin - slack || obj.position.y > height - margin + slack) acc.border_violations++;
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include "solver_final.hpp"
+#include "../thread.hpp"
+
+// Many independent solvers sharing one pool. Small runs get the inline
+// threader and are handed out whole, one per worker; runs expected to hold
+// split_threshold particles or more use the pool themselves and are stepped
+// one after another.
+struct Ensemble {
+    Threader&                            threader;
+    Threader                             serial{0};
+    int                                  split_threshold = 20000;
+    std::vector<std::unique_ptr<Solver>> runs;
+
+    Ensemble(Threader& threader_)
+        : threader{threader_}
+    {}
+
+    Solver& addRun(float width, float height, float radius, int expected_objects = 0) {
+        Threader& pool = expected_objects >= split_threshold ? threader : serial;
+        runs.push_back(std::make_unique<Solver>(width, height, radius, pool));
+        return *runs.back();
+    }
+
+    bool isSplit(int run) const {
+        return &runs[run]->threader == &threader;
+    }
+
+    int size() const {
+        return runs.size();
+    }
+
+    // Advances every run by the given number of frames. on_done(solver, run) is
+    // called as soon as a run finishes, from whichever thread ran it, so
+    // results should go into a slot per run
+    void run(int frames, std::function<void(Solver&, int)> on_done = nullptr) {
+        std::vector<int> whole;
+        for (int i = 0; i < size(); i++) {
+            if (!isSplit(i)) {
+                whole.push_back(i);
+                continue;
+            }
+            for (int f = 0; f < frames; f++) runs[i]->update();
+            if (on_done) on_done(*runs[i], i);
+        }
+
+        // Runs differ in cost, so workers pull the next one instead of
+        // taking a fixed slice
+        std::atomic<int> next{0};
+        auto worker = [&] {
+            for (int k = next++; k < static_cast<int>(whole.size()); k = next++) {
+                Solver& solver = *runs[whole[k]];
+                for (int f = 0; f < frames; f++) solver.update();
+                if (on_done) on_done(solver, whole[k]);
+            }
+        };
+        for (int i = 0; i < threader.num_threads; i++) threader.t_queue.addTask(worker);
+        worker();
+        threader.t_queue.waitUntilDone();
+    }
+};
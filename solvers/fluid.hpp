@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <SFML/Graphics.hpp>
+
+// Particles around one grid cell, copied into flat arrays so the kernel loops
+// below run over contiguous floats and vectorize
+struct FluidNeighbourhood {
+    std::vector<float> x, y, vx, vy, mass, density, pressure;
+
+    void clear() {
+        x.clear(); y.clear(); vx.clear(); vy.clear();
+        mass.clear(); density.clear(); pressure.clear();
+    }
+
+    int size() const {
+        return x.size();
+    }
+};
+
+// 2D SPH kernels (poly6 for density, spiky gradient for pressure and the
+// viscosity laplacian) with support radius h
+struct FluidKernels {
+    float h, h2, poly6, spiky, viscous;
+
+    FluidKernels(float h_)
+        : h{h_}
+        , h2{h_ * h_}
+        , poly6{4.0f / (static_cast<float>(M_PI) * std::pow(h_, 8.0f))}
+        , spiky{30.0f / (static_cast<float>(M_PI) * std::pow(h_, 5.0f))}
+        , viscous{40.0f / (static_cast<float>(M_PI) * std::pow(h_, 5.0f))}
+    {}
+
+    float density(float px, float py, const FluidNeighbourhood& n) const {
+        const float* x = n.x.data();
+        const float* y = n.y.data();
+        const float* m = n.mass.data();
+        const int count = n.size();
+        float sum = 0.0f;
+        for (int k = 0; k < count; k++) {
+            const float dx = x[k] - px, dy = y[k] - py;
+            const float t  = std::max(0.0f, h2 - (dx * dx + dy * dy));
+            sum += m[k] * t * t * t;
+        }
+        return poly6 * sum;
+    }
+
+    // Acceleration on a particle at (px, py) moving at (pvx, pvy)
+    sf::Vector2f acceleration(float px, float py, float pvx, float pvy, float density, float pressure,
+                              float viscosity, const FluidNeighbourhood& n) const {
+        const float* x  = n.x.data();
+        const float* y  = n.y.data();
+        const float* vx = n.vx.data();
+        const float* vy = n.vy.data();
+        const float* m  = n.mass.data();
+        const float* d  = n.density.data();
+        const float* p  = n.pressure.data();
+        const int count = n.size();
+        float ax = 0.0f, ay = 0.0f;
+        for (int k = 0; k < count; k++) {
+            const float dx = px - x[k], dy = py - y[k];
+            const float r  = std::sqrt(dx * dx + dy * dy);
+            const float t  = std::max(0.0f, h - r);
+            // Self and coincident pairs drop out through inv_r = 0
+            const float inv_r = r > 0.0f ? 1.0f / r : 0.0f;
+            const float push  = m[k] * (pressure + p[k]) / (2.0f * d[k]) * spiky * t * t * inv_r;
+            const float drag  = m[k] / d[k] * viscous * t * viscosity;
+            ax += push * dx + drag * (vx[k] - pvx);
+            ay += push * dy + drag * (vy[k] - pvy);
+        }
+        return {ax / density, ay / density};
+    }
+};
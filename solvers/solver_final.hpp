@@ -3,16 +3,98 @@
 #include <vector>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include <SFML/Graphics.hpp>
 #include "../particle.hpp"
 #include "../thread.hpp"
 #include "../obstacles/dot.hpp"
 #include "../obstacles/box.hpp"
+#include "../forces/force_field.hpp"
+#include "../emitters/emitter.hpp"
+#include "../utils/hash_grid.hpp"
+#include "barnes_hut.hpp"
+#include "fluid.hpp"
+#include "statistics.hpp"
+#include "diagnostics.hpp"
+#include "../utils/profiler.hpp"
+#include "../utils/number_generator.hpp"
 
+// Shared rand() state, only for single-threaded scene setup. Solver code draws
+// from CounterRNG instead
 float getRandom() {
     return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
 }
 
+// Coarser grid for particles too large for the base cells. Dense over the
+// window, or hashed like the base grid when the solver is sparse, so large
+// particles keep colliding wherever they go
+struct GridLevel {
+    float                         cell_size = 0.0f;
+    int                           level     = 0;
+    int                           width     = 0;
+    int                           height    = 0;
+    bool                          sparse    = false;
+    std::vector<std::vector<int>> cells;
+    HashGrid                      hash;
+
+    GridLevel(float cell_size_, int level_, float world_width, float world_height)
+        : cell_size{cell_size_}
+        , level{level_}
+        , width{static_cast<int>(world_width / cell_size_) + 1}
+        , height{static_cast<int>(world_height / cell_size_) + 1}
+    {}
+
+    CellRange at(int x, int y) const {
+        if (sparse) return hash.at(x, y);
+        if (x < 0 || y < 0 || x >= width || y >= height || cells.empty()) return {};
+        return cells[x * height + y];
+    }
+
+    // Files the particles of this level out of `large`, the ids of every
+    // particle above the base level
+    void build(const std::vector<Particle>& objects, const std::vector<int>& large) {
+        auto cell_of = [&](int k, int& x, int& y) {
+            const Particle& obj = objects[large[k]];
+            x = floor(obj.position.x / cell_size);
+            y = floor(obj.position.y / cell_size);
+            return obj.level == level;
+        };
+        if (sparse) {
+            if (!cells.empty()) std::vector<std::vector<int>>().swap(cells);
+            hash.build(large.size(), cell_of);
+            for (const HashGrid::Cell& cell : hash.cells) {
+                for (int i = cell.start; i < cell.start + cell.count; i++) hash.ids[i] = large[hash.ids[i]];
+            }
+            return;
+        }
+        cells.resize(width * height);
+        for (std::vector<int>& cell : cells) cell.clear();
+        for (int k = 0; k < static_cast<int>(large.size()); k++) {
+            int x, y;
+            if (!cell_of(k, x, y) || x < 0 || y < 0 || x >= width || y >= height) continue;
+            cells[x * height + y].push_back(large[k]);
+        }
+    }
+};
+
+// How contacts are resolved. Slabs move both particles in place; gather and
+// neighbour lists accumulate per-particle corrections and apply them together
+enum class CollisionMode { Slabs, Gather, NeighbourLists };
+
+enum class QueryType { Radius, Box, Nearest }; // Nearest finds k = capacity
+
+// One entry of a batched spatial query. Results are written to the caller's
+// buffer; count is the number of matches, which may exceed capacity
+struct SpatialQuery {
+    QueryType    query_type = QueryType::Radius;
+    sf::Vector2f position;       // centre, or top left corner of the box
+    sf::Vector2f box_max;
+    float        radius     = 0.0f;
+    int*         results    = nullptr;
+    int          capacity   = 0;
+    int          count      = 0;
+};
+
 class Solver {
 public:
     Solver(float width, float height, float radius, Threader& threader_) 
@@ -20,21 +102,194 @@ public:
         , window_height{height}
         , grid_size{2 * radius}
         , threader{threader_}
-    {}
+    {
+        grid_width  = window_width  / grid_size;
+        grid_height = window_height / grid_size;
+    }
 
-    virtual ~Solver() {
-        for (Thread& thread : threader.threads) {
-            thread.stop();
+    virtual ~Solver() = default;
+
+    Particle makeParticle(sf::Vector2f position, float radius, int index) const {
+        int gridx = floor(position.x / grid_size), gridy = floor(position.y / grid_size);
+        Particle newParticle = Particle(position, radius, gridx, gridy, index);
+        // Mass scales with area so particles of the solver's radius weigh 1
+        newParticle.mass  = 4.0f * radius * radius / (grid_size * grid_size);
+        newParticle.level = getLevel(radius);
+        return newParticle;
+    }
+
+    void addLevels(int level) {
+        while (static_cast<int>(grid_levels.size()) < level) {
+            const int next = grid_levels.size() + 1;
+            grid_levels.emplace_back(grid_size * (2 << grid_levels.size()), next, window_width, window_height);
         }
     }
 
+    // Like emitted particles, new objects join the grid at the next rebuild
     Particle& addObject(sf::Vector2f position, float radius) {
-        int gridx = position.x / grid_size, gridy = position.x / grid_size;
-        Particle newParticle = Particle(position, radius, gridx, gridy, objects.size());
-        grid[gridx][gridy].push_back(newParticle.id);
+        Particle newParticle = makeParticle(position, radius, objects.size());
+        newParticle.handle = newHandle(newParticle.id);
+        addLevels(newParticle.level);
         return objects.emplace_back(newParticle);
     }
 
+    // Sizes every per-particle buffer for max_objects up front, so frames
+    // below that count never allocate
+    void reserve(int max_objects) {
+        objects.reserve(max_objects);
+        objects_scratch.reserve(max_objects);
+        handle_index.reserve(max_objects);
+        free_handles.reserve(max_objects);
+        large_objects.reserve(max_objects);
+        grid_ids.reserve(max_objects);
+        grid_cell.reserve(max_objects);
+        grid_start.reserve(grid_width * grid_height + 1);
+        if (sparse_grid) hash_grid.reserve(max_objects);
+        if (collision_mode != CollisionMode::Slabs) collision_deltas.reserve(max_objects);
+    }
+
+    // Handles stay valid across compaction, unlike indices into objects
+    int newHandle(int index) {
+        if (free_handles.empty()) {
+            handle_index.push_back(index);
+            return handle_index.size() - 1;
+        }
+        int handle = free_handles.back();
+        free_handles.pop_back();
+        handle_index[handle] = index;
+        return handle;
+    }
+
+    Particle* getObject(int handle) {
+        if (handle < 0 || handle >= static_cast<int>(handle_index.size()) || handle_index[handle] < 0) return nullptr;
+        return &objects[handle_index[handle]];
+    }
+
+    // The slot is reclaimed at the end of the current substep
+    void removeObject(Particle& object) {
+        if (!object.alive) return;
+        object.alive = false;
+        pending_removals++;
+    }
+
+    Emitter& addEmitter(sf::Vector2f position, sf::Vector2f velocity, int count, float rate) {
+        Emitter newEmitter = Emitter(position, velocity, count, rate);
+        return emitters.emplace_back(newEmitter);
+    }
+
+    // Everything due this step is spawned with one resize and one fill, in
+    // emitter order, so results are the same for any thread count
+    void emitParticles(float dt) {
+        PROFILE_SCOPE("emit");
+        int total = 0;
+        emitter_offsets.resize(emitters.size() + 1);
+        for (int e = 0; e < static_cast<int>(emitters.size()); e++) {
+            emitter_offsets[e] = total;
+            total += emitters[e].due(dt);
+            addLevels(getLevel(emitters[e].radius));
+        }
+        emitter_offsets[emitters.size()] = total;
+        if (total == 0) return;
+
+        const int first = objects.size();
+        objects.resize(first + total);
+        for (int i = first; i < first + total; i++) objects[i].handle = newHandle(i);
+
+        auto fill = [&](int start, int end) {
+            int e = std::upper_bound(emitter_offsets.begin(), emitter_offsets.end(), start) - emitter_offsets.begin() - 1;
+            for (int k = start; k < end; k++) {
+                while (k >= emitter_offsets[e + 1]) e++;
+                const Emitter& emitter = emitters[e];
+                sf::Vector2f pos, vel;
+                emitter.particleAt(emitter.emitted + k - emitter_offsets[e], pos, vel);
+                Particle& obj = objects[first + k];
+                const int handle = obj.handle;
+                obj          = makeParticle(pos, emitter.radius, first + k);
+                obj.handle   = handle;
+                obj.color    = emitter.color;
+                obj.lifetime = emitter.lifetime;
+                obj.setVelocity(vel, dt);
+            }
+        };
+        if (total >= 1024) threader.parallel(total, fill);
+        else fill(0, total);
+
+        // Colour callbacks are user code, so they run here rather than on the pool
+        for (int e = 0; e < static_cast<int>(emitters.size()); e++) {
+            Emitter& emitter = emitters[e];
+            if (emitter.color_function) {
+                for (int k = emitter_offsets[e]; k < emitter_offsets[e + 1]; k++) {
+                    objects[first + k].color = emitter.colorAt(emitter.emitted + k - emitter_offsets[e]);
+                }
+            }
+            emitter.emitted += emitter_offsets[e + 1] - emitter_offsets[e];
+        }
+    }
+
+    // Hexagonal lattice at contact distance, filled from the bottom row up so
+    // a partial fill sits where gravity would have left it. Returns the count
+    int fillHexagonal(sf::FloatRect region, float radius, int max_count, sf::Color color = sf::Color::White) {
+        const float spacing    = 2.0f * radius;
+        const float row_height = spacing * 0.8660254f;
+        // Odd rows are shifted by a radius, so every row must fit that too
+        if (region.height < spacing || region.width < spacing + radius) return 0;
+        const int   rows       = std::floor((region.height - spacing) / row_height) + 1;
+        const int   per_row    = std::floor((region.width - spacing - radius) / spacing) + 1;
+        const int   total      = std::min(max_count, rows * per_row);
+        if (total <= 0) return 0;
+
+        const int first = objects.size();
+        objects.resize(first + total);
+        for (int i = first; i < first + total; i++) objects[i].handle = newHandle(i);
+        addLevels(getLevel(radius));
+        threader.parallel(total, [&](int start, int end) {
+            for (int k = start; k < end; k++) {
+                const int row = k / per_row, col = k % per_row;
+                sf::Vector2f pos = {region.left + radius + col * spacing + (row & 1) * radius,
+                                    region.top + region.height - radius - row * row_height};
+                Particle& obj = objects[first + k];
+                const int handle = obj.handle;
+                obj        = makeParticle(pos, radius, first + k);
+                obj.handle = handle;
+                obj.color  = color;
+            }
+        });
+        return total;
+    }
+
+    // Resolves leftover overlap with contact passes only, dropping whatever
+    // velocity the corrections imply so the packing starts at rest
+    void relax(int iterations) {
+        updateGrid();
+        for (int i = 0; i < iterations; i++) {
+            checkCollisions();
+            checkDotCollisions();
+            checkBoxCollisions();
+            if (bounded) applyBorder();
+            threader.parallel(objects.size(), [&](int start, int end) {
+                for (int k = start; k < end; k++) {
+                    Particle& obj = objects[k];
+                    obj.position_last = obj.position;
+                    obj.acceleration  = {0.0f, 0.0f};
+                    obj.gridx = floor(obj.position.x / grid_size);
+                    obj.gridy = floor(obj.position.y / grid_size);
+                }
+            });
+            updateGrid();
+        }
+    }
+
+    void addSink(sf::Vector2f dimensions, sf::Vector2f position) {
+        sinks.emplace_back(position - dimensions * 0.5f, dimensions);
+    }
+
+    // Level k cells are grid_size * 2^k wide and hold radii up to half that
+    int getLevel(float radius) const {
+        int level = 0;
+        while (2.0f * radius > grid_size * (1 << level)) level++;
+        return level;
+    }
+
     ObstacleDot& addObstacleDot(float radius, sf::Vector2f start_position, 
             sf::Vector2f end_position = {-1.0f, -1.0f}) {
         // end position left empty signifies no movement
@@ -52,37 +307,463 @@ public:
         return box_obstacles.emplace_back(newBox);
     }
 
+    ForceField& addForceField(FieldType field_type, sf::Vector2f position, float radius, float strength) {
+        ForceField newField = ForceField(field_type, position, radius, strength);
+        return force_fields.emplace_back(newField);
+    }
+
     void mousePull(sf::Vector2f pos, float radius) {
-        for (Particle& obj : objects) {
-            sf::Vector2f dir = pos - obj.position;
-            float dist = sqrt(dir.x * dir.x + dir.y * dir.y);
-            obj.accelerate(dir * std::max(0.0f, 5 * (radius - dist)));
-        }
+        applyForceField(ForceField(FieldType::Attractor, pos, radius, 5.0f));
     }
 
     void mousePush(sf::Vector2f pos, float radius) {
-        for (Particle& obj : objects) {
-            sf::Vector2f dir = pos - obj.position;
-            float dist = sqrt(dir.x * dir.x + dir.y * dir.y);
-            obj.accelerate(dir * std::min(0.0f, -5 * (radius - dist)));
+        applyForceField(ForceField(FieldType::Repeller, pos, radius, 5.0f));
+    }
+
+    // Only visits the cells under the field, one column range per task
+    void applyForceField(const ForceField& field) {
+        const int left   = floor((field.position.x - field.radius) / grid_size);
+        const int right  = floor((field.position.x + field.radius) / grid_size);
+        const int top    = floor((field.position.y - field.radius) / grid_size);
+        const int bottom = floor((field.position.y + field.radius) / grid_size);
+        threader.parallel(right - left + 1, [&](int start, int end) {
+            for (int i = left + start; i < left + end; i++) {
+                for (int j = top; j <= bottom; j++) {
+                    for (int obj_id : cellAt(i, j)) {
+                        Particle& obj = objects[obj_id];
+                        obj.accelerate(field.accelerationAt(obj.position));
+                    }
+                }
+            }
+        });
+        for (int obj_id : large_objects) {
+            Particle& obj = objects[obj_id];
+            obj.accelerate(field.accelerationAt(obj.position));
+        }
+    }
+
+    void applyForceFields() {
+        PROFILE_SCOPE("force fields");
+        for (const ForceField& field : force_fields) {
+            if (field.enabled) applyForceField(field);
+        }
+    }
+
+    // Largest distance any particle moved during the last substep
+    float maxDisplacement() {
+        std::atomic<float> max_sq{0.0f};
+        threader.parallel(objects.size(), [&](int start, int end) {
+            float local = 0.0f;
+            for (int i = start; i < end; i++) {
+                const sf::Vector2f v = objects[i].getVelocity() / static_cast<float>(objects[i].stride);
+                local = std::max(local, v.x * v.x + v.y * v.y);
+            }
+            float current = max_sq.load();
+            while (local > current && !max_sq.compare_exchange_weak(current, local)) {}
+        });
+        return sqrt(max_sq.load());
+    }
+
+    // Changes the substep length, rescaling the implicit Verlet velocities so
+    // particles keep their speed in px/s
+    void setSubsteps(int count) {
+        if (count == substeps) return;
+        const float new_dt = frame_dt / count;
+        const float ratio  = new_dt / substep_dt;
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                Particle& obj = objects[i];
+                obj.position_last = obj.position - obj.getVelocity() * ratio;
+            }
+        });
+        substeps   = count;
+        substep_dt = new_dt;
+    }
+
+    // Enough substeps that the fastest particle moves at most cfl_factor cells
+    // per substep over the coming frame. Steps up at once, but only steps down
+    // one at a time after substep_hold calm frames, since every switch shifts
+    // how far contacts compress and flipping back and forth pumps energy in
+    void adaptSubsteps() {
+        PROFILE_SCOPE("adapt substeps");
+        const float speed  = maxDisplacement() / substep_dt;
+        const int   wanted = std::clamp(static_cast<int>(ceil(speed * frame_dt / (cfl_factor * grid_size))),
+                                        min_substeps, max_substeps);
+        if (wanted >= substeps) {
+            calm_frames = 0;
+            setSubsteps(wanted);
+        } else if (++calm_frames >= substep_hold) {
+            calm_frames = 0;
+            setSubsteps(substeps - 1);
         }
     }
 
+    int tileStride(int x, int y) const {
+        const int tx = x / rate_tile, ty = y / rate_tile;
+        if (x < 0 || y < 0 || tx >= tiles_x || ty >= tiles_y) return 1;
+        return tile_stride[tx * tiles_y + ty];
+    }
+
+    // Tiles whose particles only step every few substeps. A pair of cells can
+    // be skipped when neither tile steps on this substep
+    bool cellActive(int x, int y) const {
+        return (substep_index + 1) % tileStride(x, y) == 0;
+    }
+
+    // Gives every tile the largest stride (1, 2, 4 or 8 substeps per step) that
+    // keeps its fastest particle under cfl_factor cells per step, and stride 1
+    // wherever a moving obstacle can reach this frame or a contact is deeper
+    // than deep_contact. Each tile then takes the
+    // smallest stride around it, the most finely stepped neighbour, so nothing
+    // fast can reach a coarse tile within the frame. Particles take their
+    // tile's stride for the frame
+    void classifyTiles() {
+        PROFILE_SCOPE("classify tiles");
+        tiles_x = (grid_width + rate_tile - 1) / rate_tile;
+        tiles_y = (grid_height + rate_tile - 1) / rate_tile;
+        tile_speed.assign(tiles_x * tiles_y, 0.0f);
+        tile_depth.assign(tiles_x * tiles_y, 0.0f);
+        tile_stride.resize(tiles_x * tiles_y, 1);
+        tile_wanted.resize(tiles_x * tiles_y, 1);
+        tile_calm.resize(tiles_x * tiles_y, 0);
+
+        // Every stride has to divide the frame so all particles line up at its end
+        int frame_stride = 1;
+        while (frame_stride < max_stride && static_cast<int>(substeps) % (frame_stride * 2) == 0) frame_stride *= 2;
+
+        // Deepest overlap per tile, as a fraction of the contact distance. A
+        // coarse step lets a loaded pile sink further than a full-rate one, so
+        // deep contacts keep their tile at full rate until they relax
+        const int dx[] = {1, 1, 0, 0, -1};
+        const int dy[] = {0, 1, 0, 1, 1};
+        threader.parallel(tiles_x, [&](int start, int end) {
+            for (int tx = start; tx < end; tx++) {
+                const int last_x = std::min(grid_width, (tx + 1) * rate_tile);
+                for (int x = tx * rate_tile; x < last_x; x++) {
+                    for (int y = 0; y < grid_height; y++) {
+                        float& speed = tile_speed[tx * tiles_y + y / rate_tile];
+                        float& depth = tile_depth[tx * tiles_y + y / rate_tile];
+                        const CellRange ids = cellAt(x, y);
+                        for (int obj_id : ids) {
+                            const Particle&    obj = objects[obj_id];
+                            const sf::Vector2f v   = obj.getVelocity() / static_cast<float>(obj.stride);
+                            speed = std::max(speed, v.x * v.x + v.y * v.y);
+                        }
+                        for (int k = 0; k < 5 && !ids.empty(); k++) {
+                            for (int id_1 : ids) {
+                                for (int id_2 : cellAt(x + dx[k], y + dy[k])) {
+                                    if (k == 2 && id_2 <= id_1) continue;
+                                    depth = std::max(depth, contactDepth(objects[id_1], objects[id_2]));
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        // Refine at once, coarsen one level at a time after rate_hold calm
+        // frames: a tile flipping rates every frame pumps energy into it
+        const float limit = cfl_factor * grid_size;
+        for (int t = 0; t < tiles_x * tiles_y; t++) {
+            const float speed = sqrt(tile_speed[t]);
+            int stride = 1;
+            while (stride < frame_stride && speed * stride * 2 <= limit && tile_depth[t] <= deep_contact) stride *= 2;
+            if (stride < tile_wanted[t]) {
+                tile_wanted[t] = stride;
+                tile_calm[t]   = 0;
+            } else if (stride > tile_wanted[t] && ++tile_calm[t] >= rate_hold) {
+                tile_wanted[t] *= 2;
+                tile_calm[t]    = 0;
+            }
+            tile_wanted[t] = std::min(tile_wanted[t], frame_stride);
+        }
+        refineAroundObstacles();
+        for (int tx = 0; tx < tiles_x; tx++) {
+            for (int ty = 0; ty < tiles_y; ty++) {
+                int stride = tile_wanted[tx * tiles_y + ty];
+                for (int nx = std::max(0, tx - 1); nx <= std::min(tiles_x - 1, tx + 1); nx++) {
+                    for (int ny = std::max(0, ty - 1); ny <= std::min(tiles_y - 1, ty + 1); ny++) {
+                        stride = std::min(stride, tile_wanted[nx * tiles_y + ny]);
+                    }
+                }
+                tile_stride[tx * tiles_y + ty] = stride;
+            }
+        }
+
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                Particle& obj = objects[i];
+                const int stride = obj.level > 0 ? 1 : tileStride(obj.gridx, obj.gridy);
+                if (stride == obj.stride) continue;
+                // Keep the speed in px/s across the change of step length
+                obj.position_last = obj.position - obj.getVelocity() * (static_cast<float>(stride) / obj.stride);
+                obj.stride        = stride;
+            }
+        });
+    }
+
+    // The particles a moving obstacle is about to hit are still slow, so
+    // their speed alone would leave the tile coarse until after the impact.
+    // Every tile the obstacle's bounds sweep over the coming frame is forced
+    // to stride 1, and coarsens again only after rate_hold calm frames
+    void refineAroundObstacles() {
+        const float tile_size = grid_size * rate_tile;
+        auto refine = [&](sf::Vector2f from, sf::Vector2f to, float reach) {
+            const int left   = std::max(0, static_cast<int>(floor((std::min(from.x, to.x) - reach) / tile_size)));
+            const int right  = std::min(tiles_x - 1, static_cast<int>(floor((std::max(from.x, to.x) + reach) / tile_size)));
+            const int top    = std::max(0, static_cast<int>(floor((std::min(from.y, to.y) - reach) / tile_size)));
+            const int bottom = std::min(tiles_y - 1, static_cast<int>(floor((std::max(from.y, to.y) + reach) / tile_size)));
+            for (int tx = left; tx <= right; tx++) {
+                for (int ty = top; ty <= bottom; ty++) {
+                    tile_wanted[tx * tiles_y + ty] = 1;
+                    tile_calm[tx * tiles_y + ty]   = 0;
+                }
+            }
+        };
+        for (const ObstacleDot& dot : dot_obstacles) {
+            if (dot.start_position == dot.end_position) continue;
+            ObstacleDot next = dot;
+            next.update(frame_dt);
+            refine(dot.position, next.position, dot.radius + grid_size);
+        }
+        for (const ObstacleBox& box : box_obstacles) {
+            if (box.durability <= 0) continue;
+            if (box.start_position == box.end_position && box.rotation_speed == 0.0f) continue;
+            ObstacleBox next = box;
+            next.update(frame_dt);
+            // Half the diagonal covers the box at any rotation
+            refine(box.position, next.position, 0.5f * std::hypot(box.dimensions.x, box.dimensions.y) + grid_size);
+        }
+    }
+
+    // Back to one step per substep for everything
+    void resetStrides() {
+        tile_stride.clear();
+        tile_wanted.clear();
+        tile_calm.clear();
+        tiles_x = tiles_y = 0;
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                Particle& obj = objects[i];
+                if (obj.stride == 1) continue;
+                obj.position_last = obj.position - obj.getVelocity() / static_cast<float>(obj.stride);
+                obj.stride        = 1;
+            }
+        });
+    }
+
     void update() {
+        if (adaptive_substeps) adaptSubsteps();
+        if (multirate && !sparse_grid) classifyTiles();
+        else if (tiles_x > 0) resetStrides();
         for (int i = 0; i < substeps; i++) {
+            substep_index = i;
+            substep_count++;
+            if (!emitters.empty()) emitParticles(substep_dt);
             applyGravity();
+            applyForceFields();
+            long_range.apply(objects, threader);
+            if (fluid) applyFluidForces();
             checkCollisions();
             checkDotCollisions();
             checkBoxCollisions();
-            applyBorder();
+            if (bounded) applyBorder();
             updateObjects(substep_dt);
             updateObstacles(substep_dt);
+            if (pending_removals > 0) compactObjects();
             updateGrid();
         }
+        if (diagnostics.due()) diagnose();
+    }
+
+    // Remaining penetration between particles of every level, into obstacles,
+    // and particles left outside the border. Read-only, so the columns are
+    // split freely
+    void diagnose() {
+        PROFILE_SCOPE("diagnostics");
+        const int dx[] = {1, 1, 0, 0, -1};
+        const int dy[] = {0, 1, 0, 1, 1};
+        const int first_col = sparse_grid ? hash_grid.min_x : 0;
+        const int num_cols  = !sparse_grid ? grid_width : hash_grid.cells.empty() ? 0 : hash_grid.max_x + 1 - first_col;
+        diagnostics.begin(3 * (threader.num_threads + 1) + 1);
+        threader.parallel(num_cols, [&](int start, int end) {
+            if (start >= end) return;
+            DiagnosticsAccumulator& acc = diagnostics.acquire();
+            forEachCellInSlice(first_col + start, first_col + end, [&](int x, int y, CellRange ids) {
+                for (int k = 0; k < 5; k++) {
+                    for (int id_1 : ids) {
+                        for (int id_2 : cellAt(x + dx[k], y + dy[k])) {
+                            if (k == 2 && id_2 <= id_1) continue; // own cell, each pair once
+                            diagnostics.addPair(acc, objects[id_1], objects[id_2]);
+                        }
+                    }
+                }
+            });
+        }, "diagnostics pairs");
+        if (!large_objects.empty()) {
+            DiagnosticsAccumulator& acc = diagnostics.acquire();
+            forEachLevelPair([&](int id_1, int id_2) { diagnostics.addPair(acc, objects[id_1], objects[id_2]); });
+        }
+        const int num_obstacles = dot_obstacles.size() + box_obstacles.size();
+        threader.parallel(num_obstacles, [&](int start, int end) {
+            if (start >= end) return;
+            DiagnosticsAccumulator& acc = diagnostics.acquire();
+            for (int i = start; i < end; i++) {
+                if (i < static_cast<int>(dot_obstacles.size())) diagnoseDot(acc, dot_obstacles[i]);
+                else diagnoseBox(acc, box_obstacles[i - dot_obstacles.size()]);
+            }
+        }, "diagnostics obstacles");
+        if (bounded) {
+            threader.parallel(objects.size(), [&](int start, int end) {
+                if (start >= end) return;
+                DiagnosticsAccumulator& acc = diagnostics.acquire();
+                for (int i = start; i < end; i++) {
+                    const Particle& obj = objects[i];
+                    if (obj.alive) diagnostics.addBorder(acc, obj, window_width, window_height, std::max(grid_size, obj.radius));
+                }
+            }, "diagnostics border");
+        }
+        diagnostics.end();
+    }
+
+    // Calls callback(obj_id) for base particles in the cells within reach of
+    // center and for every large particle
+    template<typename F>
+    void forEachNear(sf::Vector2f center, float reach, F&& callback) const {
+        const int left   = floor((center.x - reach) / grid_size);
+        const int right  = floor((center.x + reach) / grid_size);
+        const int top    = floor((center.y - reach) / grid_size);
+        const int bottom = floor((center.y + reach) / grid_size);
+        for (int i = left; i <= right; i++) {
+            for (int j = top; j <= bottom; j++) {
+                for (int obj_id : cellAt(i, j)) callback(obj_id);
+            }
+        }
+        for (int obj_id : large_objects) callback(obj_id);
+    }
+
+    void diagnoseDot(DiagnosticsAccumulator& acc, const ObstacleDot& dot) const {
+        forEachNear(dot.position, dot.radius + grid_size, [&](int obj_id) {
+            const Particle&    obj = objects[obj_id];
+            const sf::Vector2f v   = obj.position - dot.position;
+            const float depth = dot.radius + obj.radius - std::sqrt(v.x * v.x + v.y * v.y);
+            if (depth > 0.0f) diagnostics.addObstacle(acc, obj, depth);
+        });
+    }
+
+    // Signed distance from the particle's centre to the rotated box, against
+    // its radius
+    void diagnoseBox(DiagnosticsAccumulator& acc, const ObstacleBox& box) const {
+        if (box.durability <= 0) return;
+        sf::Transform anticlockwise;
+        anticlockwise.rotate(-box.rotation);
+        const sf::Vector2f size = box.dimensions * 0.5f;
+        forEachNear(box.position, std::hypot(size.x, size.y) + grid_size, [&](int obj_id) {
+            const Particle&    obj    = objects[obj_id];
+            const sf::Vector2f rotpos = anticlockwise.transformPoint(obj.position - box.position);
+            const float qx = std::abs(rotpos.x) - size.x, qy = std::abs(rotpos.y) - size.y;
+            const float outside  = std::hypot(std::max(qx, 0.0f), std::max(qy, 0.0f));
+            const float distance = outside + std::min(std::max(qx, qy), 0.0f);
+            if (distance < obj.radius) diagnostics.addObstacle(acc, obj, obj.radius - distance);
+        });
+    }
+
+    // Queries only read the grid and positions, so any number can run at once,
+    // but not while update() is running
+    int queryRadius(sf::Vector2f center, float radius, int* results, int capacity) const {
+        int count = 0;
+        auto test = [&](int obj_id) {
+            sf::Vector2f v = objects[obj_id].position - center;
+            if (v.x * v.x + v.y * v.y > radius * radius) return;
+            if (count < capacity) results[count] = obj_id;
+            count++;
+        };
+        const int left   = floor((center.x - radius) / grid_size);
+        const int right  = floor((center.x + radius) / grid_size);
+        const int top    = floor((center.y - radius) / grid_size);
+        const int bottom = floor((center.y + radius) / grid_size);
+        for (int i = left; i <= right; i++)
+            for (int j = top; j <= bottom; j++)
+                for (int obj_id : cellAt(i, j)) test(obj_id);
+        for (int obj_id : large_objects) test(obj_id);
+        return count;
+    }
+
+    int queryBox(sf::Vector2f box_min, sf::Vector2f box_max, int* results, int capacity) const {
+        int count = 0;
+        auto test = [&](int obj_id) {
+            const sf::Vector2f pos = objects[obj_id].position;
+            if (pos.x < box_min.x || pos.y < box_min.y || pos.x > box_max.x || pos.y > box_max.y) return;
+            if (count < capacity) results[count] = obj_id;
+            count++;
+        };
+        for (int i = floor(box_min.x / grid_size); i <= floor(box_max.x / grid_size); i++)
+            for (int j = floor(box_min.y / grid_size); j <= floor(box_max.y / grid_size); j++)
+                for (int obj_id : cellAt(i, j)) test(obj_id);
+        for (int obj_id : large_objects) test(obj_id);
+        return count;
+    }
+
+    // Searches rings of cells outwards, keeping results sorted by distance,
+    // and stops once the next ring cannot hold anything closer
+    int queryNearest(sf::Vector2f center, int k, int* results) const {
+        if (k <= 0) return 0;
+        int count = 0;
+        auto dist2 = [&](int obj_id) {
+            sf::Vector2f v = objects[obj_id].position - center;
+            return v.x * v.x + v.y * v.y;
+        };
+        auto test = [&](int obj_id) {
+            const float d = dist2(obj_id);
+            if (count == k && d >= dist2(results[k - 1])) return;
+            int slot = count < k ? count++ : k - 1;
+            while (slot > 0 && dist2(results[slot - 1]) > d) {
+                results[slot] = results[slot - 1];
+                slot--;
+            }
+            results[slot] = obj_id;
+        };
+        for (int obj_id : large_objects) test(obj_id);
+
+        const int cx = floor(center.x / grid_size), cy = floor(center.y / grid_size);
+        const int lo_x = sparse_grid ? hash_grid.min_x : 0, hi_x = sparse_grid ? hash_grid.max_x : grid_width - 1;
+        const int lo_y = sparse_grid ? hash_grid.min_y : 0, hi_y = sparse_grid ? hash_grid.max_y : grid_height - 1;
+        const int max_ring = std::max(std::max(cx - lo_x, hi_x - cx), std::max(cy - lo_y, hi_y - cy));
+        for (int ring = 0; ring <= max_ring; ring++) {
+            for (int i = cx - ring; i <= cx + ring; i++) {
+                const bool edge = i == cx - ring || i == cx + ring;
+                for (int j = cy - ring; j <= cy + ring; j += edge ? 1 : 2 * ring) {
+                    for (int obj_id : cellAt(i, j)) test(obj_id);
+                }
+            }
+            const float reach = ring * grid_size;
+            if (count == k && dist2(results[k - 1]) <= reach * reach) break;
+        }
+        return count;
+    }
+
+    void queryBatch(std::vector<SpatialQuery>& queries) const {
+        threader.parallel(queries.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                SpatialQuery& query = queries[i];
+                switch (query.query_type) {
+                case QueryType::Radius:
+                    query.count = queryRadius(query.position, query.radius, query.results, query.capacity);
+                    break;
+                case QueryType::Box:
+                    query.count = queryBox(query.position, query.box_max, query.results, query.capacity);
+                    break;
+                case QueryType::Nearest:
+                    query.count = queryNearest(query.position, query.capacity, query.results);
+                    break;
+                }
+            }
+        });
     }
 
     void setObjectVelocity(Particle& object, sf::Vector2f vel) {
-        object.setVelocity(vel, substep_dt);
+        object.setVelocity(vel, substep_dt * object.stride);
     }
 
     float                    window_width     = 1260.0f;
@@ -90,15 +771,85 @@ public:
     float                    dampening        = 0.8f;
     sf::Vector2f             gravity          = {0.0f, 0.0f}; // 250
     std::vector<Particle>    objects;
+    std::vector<int>         handle_index;  // handle -> index in objects, -1 once removed
+    std::vector<int>         free_handles;
+
+    std::vector<sf::FloatRect> sinks;
+    bool                     cull_out_of_bounds = false;
+    float                    cull_margin      = 100.0f;
+    std::atomic<int>         pending_removals = 0;
+    std::vector<Particle>    objects_scratch;
+    std::vector<int>         compact_alive;
+    std::vector<int>         compact_dead;
 
     std::vector<ObstacleDot>  dot_obstacles;
     std::vector<ObstacleBox>  box_obstacles;
+    std::vector<ForceField>   force_fields;
+    std::vector<Emitter>      emitters;
+    std::vector<int>          emitter_offsets;
+
+    BarnesHut                long_range;
+    SolverStats              stats;
+    SolverDiagnostics        diagnostics;
+
+    bool                     fluid              = false;
+    float                    fluid_rest_density = 0.0f; // 0 uses a packed hex lattice
+    float                    fluid_stiffness    = 4000.0f;
+    float                    fluid_viscosity    = 2.0f;
+    std::vector<float>       fluid_density;
+    std::vector<float>       fluid_pressure;
 
     float                    substeps         = 8;
     float                    substep_dt       = 1.0f / (60 * 8);
+    int                      substep_index    = 0;
+    uint64_t                 substep_count    = 0; // since the start, keys the random streams
+    uint64_t                 seed             = 1;
+    float                    frame_dt         = 1.0f / 60;
+    bool                     adaptive_substeps = false;
+    int                      min_substeps     = 4;  // dense piles want 8 to stay stiff
+    int                      max_substeps     = 16;
+    float                    cfl_factor       = 0.25f; // cells moved per substep
+    int                      substep_hold     = 30;
+    int                      calm_frames      = 0;
+
+    // Multi-rate stepping suits free-flying regions. Loaded piles hold deep
+    // contacts and stay at full rate, and only gas-like scenes should skip
+    // collisions between idle tiles
+    bool                     multirate        = false; // dense grid only
+    int                      rate_tile        = 8;     // tile edge in cells
+    int                      max_stride       = 8;
+    bool                     skip_idle_pairs  = false;
+    int                      tiles_x          = 0;
+    int                      tiles_y          = 0;
+    std::vector<int>         tile_stride;
+    std::vector<int>         tile_wanted;
+    std::vector<int>         tile_calm;
+    int                      rate_hold        = 30;
+    float                    deep_contact     = 0.05f; // overlap, as a fraction of the contact distance
+    std::vector<float>       tile_speed;
+    std::vector<float>       tile_depth;
 
     float                    grid_size        = 16;
-    std::vector<int>         grid[640][400];
+    int                      grid_width       = 0;
+    int                      grid_height      = 0;
+    std::vector<int>         grid_start;  // first id of each cell in grid_ids, plus the total
+    std::vector<int>         grid_ids;
+    std::vector<int>         grid_cell;   // cell of each particle, -1 when not in the dense grid
+    bool                     sparse_grid      = false; // hash only the occupied cells
+    bool                     bounded          = true;
+    HashGrid                 hash_grid;
+    std::vector<GridLevel>   grid_levels;
+    std::vector<int>         large_objects;
+
+    CollisionMode            collision_mode   = CollisionMode::Slabs;
+    float                    gather_response  = 0.25f;
+    std::vector<sf::Vector2f> collision_deltas;
+
+    float                    neighbour_skin   = 0.25f * grid_size;
+    int                      neighbour_builds = 0;
+    std::vector<int>         neighbour_start;
+    std::vector<int>         neighbour_ids;
+    std::vector<sf::Vector2f> neighbour_origin;
 
     Threader&                threader;
 
@@ -111,93 +862,393 @@ public:
         sf::Vector2f dy = { vel.x, -vel.y};
         sf::Vector2f dx = {-vel.x,  vel.y};
 
-        if (pos.x < grid_size || pos.x > window_width - grid_size) { // Bounce off left/right
-            if (pos.x < grid_size) npos.x = grid_size;
-            if (pos.x > window_width - grid_size) npos.x = window_width - grid_size;
+        const float     margin = std::max(grid_size, obj.radius);
+
+        if (pos.x < margin || pos.x > window_width - margin) { // Bounce off left/right
+            if (pos.x < margin) npos.x = margin;
+            if (pos.x > window_width - margin) npos.x = window_width - margin;
             obj.position = npos;
             obj.setVelocity(dx * dampening, 1.0);
         }
-        if (pos.y < grid_size || pos.y > window_height - grid_size) { // Bounce off top/bottom
-            if (pos.y < grid_size) npos.y = grid_size;
-            if (pos.y > window_height - grid_size) npos.y = window_height - grid_size;
+        if (pos.y < margin || pos.y > window_height - margin) { // Bounce off top/bottom
+            if (pos.y < margin) npos.y = margin;
+            if (pos.y > window_height - margin) npos.y = window_height - margin;
             obj.position = npos;
             obj.setVelocity(dy * dampening, 1.0);
         }
     }
 
     void applyBorder() {
+        PROFILE_SCOPE("border");
         threader.parallel(objects.size(), [&](int start, int end) {
             for (int i = start; i < end; i++) bounceOffBorder(i);
-        });
+        }, "border");
     }
 
-    void collideCells (int x1, int y1, int x2, int y2) {
-        for (int id_1 : grid[x1][y1]) {
+    void resolvePair (Particle& obj_1, Particle& obj_2) {
+        sf::Vector2f v = obj_1.position - obj_2.position;
+        float dist     = v.x * v.x + v.y * v.y;
+        float min_dist = obj_1.radius + obj_2.radius;
+
+        if (dist < min_dist * min_dist && dist > 0.0f) {
+            dist = sqrt(dist);
+            float delta = 0.5f * (min_dist - dist) / (obj_1.mass + obj_2.mass);
+            sf::Vector2f n = v / dist * delta;
+            // Larger particle moves less
+            obj_1.position += n * obj_2.mass;
+            obj_2.position -= n * obj_1.mass;
+        }
+    }
+
+    // Overlap of a pair as a fraction of its contact distance, 0 when apart
+    static float contactDepth (const Particle& obj_1, const Particle& obj_2) {
+        const sf::Vector2f v = obj_1.position - obj_2.position;
+        const float min_dist = obj_1.radius + obj_2.radius;
+        const float dist_sq  = v.x * v.x + v.y * v.y;
+        if (dist_sq >= min_dist * min_dist) return 0.0f;
+        return 1.0f - std::sqrt(dist_sq) / min_dist;
+    }
+
+    // Particles in the base cell at (x, y), from whichever grid backend is active
+    CellRange cellAt (int x, int y) const {
+        if (sparse_grid) return hash_grid.at(x, y);
+        if (x < 0 || y < 0 || x >= grid_width || y >= grid_height || grid_start.empty()) return {};
+        const int cell = x * grid_height + y;
+        return {grid_ids.data() + grid_start[cell], grid_ids.data() + grid_start[cell + 1]};
+    }
+
+    void collideCells (CellRange cell_1, CellRange cell_2) {
+        for (int id_1 : cell_1) {
             Particle& obj_1 = objects[id_1];
-            for (int id_2 : grid[x2][y2]) {
+            for (int id_2 : cell_2) {
                 if (id_1 == id_2) continue;
-                Particle& obj_2 = objects[id_2];
-                sf::Vector2f v = obj_1.position - obj_2.position;
-                float dist     = v.x * v.x + v.y * v.y;
-                float min_dist = grid_size;
-
-                if (dist < min_dist * min_dist) {
-                    dist = sqrt(dist);
-                    float delta = 0.25f * (min_dist - dist);
-                    sf::Vector2f n = v / dist * delta;
-                    // Larger particle moves less
-                    obj_1.position += n;
-                    obj_2.position -= n;
+                resolvePair(obj_1, objects[id_2]);
+            }
+        }
+    }
+
+    CellRange levelCell (int level, int x, int y) const {
+        if (level == 0) return cellAt(x, y);
+        return grid_levels[level - 1].at(x, y);
+    }
+
+    // Calls callback(id_1, id_2) once for every candidate pair of a large
+    // particle with a particle of its own or a lower level
+    template<typename F>
+    void forEachLevelPair (F&& callback) const {
+        for (int id_1 : large_objects) {
+            const Particle& obj_1 = objects[id_1];
+            for (int level = 0; level <= obj_1.level; level++) {
+                const float cell  = level == 0 ? grid_size : grid_levels[level - 1].cell_size;
+                const float reach = obj_1.radius + 0.5f * cell;
+                const int left    = floor((obj_1.position.x - reach) / cell);
+                const int right   = floor((obj_1.position.x + reach) / cell);
+                const int top     = floor((obj_1.position.y - reach) / cell);
+                const int bottom  = floor((obj_1.position.y + reach) / cell);
+                for (int i = left; i <= right; i++) {
+                    for (int j = top; j <= bottom; j++) {
+                        for (int id_2 : levelCell(level, i, j)) {
+                            if (level == obj_1.level && id_2 <= id_1) continue;
+                            callback(id_1, id_2);
+                        }
+                    }
                 }
             }
         }
     }
 
+    // Large particles are few, so they are resolved serially against every
+    // level at or below their own
+    void checkLevelCollisions () {
+        PROFILE_SCOPE("level collisions");
+        forEachLevelPair([&](int id_1, int id_2) { resolvePair(objects[id_1], objects[id_2]); });
+    }
+
+    // Calls callback(x, y, ids) for every occupied base cell in columns [lcol, rcol)
+    template<typename F>
+    void forEachCellInSlice (int lcol, int rcol, F&& callback) {
+        if (sparse_grid) {
+            const std::pair<int, int> range = hash_grid.columns(lcol, rcol);
+            for (int c = range.first; c < range.second; c++) {
+                const HashGrid::Cell& cell = hash_grid.cells[c];
+                const int* first = hash_grid.ids.data() + cell.start;
+                callback(cell.x, cell.y, CellRange{first, first + cell.count});
+            }
+            return;
+        }
+        for (int i = lcol; i < rcol; i++) {
+            for (int j = 0; j < grid_height; j++) {
+                CellRange ids = cellAt(i, j);
+                if (!ids.empty()) callback(i, j, ids);
+            }
+        }
+    }
+
     void checkCollisionsInSlice (int lcol, int rcol) {
-        int num_cells_width  = window_width  / grid_size;
-        int num_cells_height = window_height / grid_size;
         int      dx[] = {1, 1, 0, 0, -1};
         int      dy[] = {0, 1, 0, 1, 1};
-        for (int i = lcol; i < rcol; i++) {
-            for (int j = 0; j < num_cells_height; j++) {
-                if (!grid[i][j].size()) continue;
-                for (int k = 0; k < 5; k++) {
-                    int nx = i + dx[k], ny = j + dy[k];
-                    if (nx < 0 || ny < 0 || nx >= num_cells_width || ny >= num_cells_height) continue;
-                    collideCells(i, j, nx, ny);
-                }   
+        const bool skip = skip_idle_pairs && tiles_x > 0;
+        forEachCellInSlice(lcol, rcol, [&](int x, int y, CellRange ids) {
+            const bool active = !skip || cellActive(x, y);
+            for (int k = 0; k < 5; k++) {
+                if (active || cellActive(x + dx[k], y + dy[k])) collideCells(ids, cellAt(x + dx[k], y + dy[k]));
             }
-        }
+        });
     }
 
     void checkCollisions () {
-        int num_cells   = window_width / grid_size;
+        switch (collision_mode) {
+        case CollisionMode::Slabs:
+            checkCollisionsSlabs();
+            break;
+        case CollisionMode::Gather:
+            checkCollisionsGather();
+            break;
+        case CollisionMode::NeighbourLists:
+            checkCollisionsNeighbours();
+            break;
+        }
+        if (!large_objects.empty()) checkLevelCollisions();
+    }
+
+    void checkCollisionsSlabs () {
+        PROFILE_SCOPE("collisions slabs");
+        forEachSlab([this](int lcol, int rcol) { checkCollisionsInSlice(lcol, rcol); });
+    }
+
+    // Runs slice(lcol, rcol) over column slabs in a left and a right pass, so
+    // slabs running at the same time never write to neighbouring columns
+    template<typename F>
+    void forEachSlab (F&& slice) {
+        int first_col   = sparse_grid ? hash_grid.min_x : 0;
+        int num_cells   = sparse_grid ? hash_grid.max_x + 1 - first_col : grid_width;
         int slice_count = threader.num_threads * 2;
-        int slice_size  = num_cells / slice_count;
+        int slice_size  = slice_count > 0 ? num_cells / slice_count : 0;
+        if (num_cells <= 0) return;
+        // Slabs narrower than two columns would share cells across tasks
+        if (slice_size < 2) {
+            slice(first_col, first_col + num_cells);
+            return;
+        }
+
+        {
+            PROFILE_SCOPE("slab left pass");
+            for (int i = 0; i < threader.num_threads; i++) {
+                const int start = first_col + 2 * i * slice_size;
+                const int end   = start + slice_size;
+                threader.t_queue.addTask([&slice, start, end]{ slice(start, end); }, "slab left");
+            }
+            if (slice_count * slice_size < num_cells) {
+                const int start = first_col + slice_count * slice_size;
+                const int end   = first_col + num_cells;
+                threader.t_queue.addTask([&slice, start, end]{ slice(start, end); }, "slab left");
+            }
+            threader.t_queue.waitUntilDone();
+        }
+        {
+            PROFILE_SCOPE("slab right pass");
+            for (int i = 0; i < threader.num_threads; i++) {
+                const int start = first_col + (2 * i + 1) * slice_size;
+                const int end   = start + slice_size;
+                threader.t_queue.addTask([&slice, start, end]{ slice(start, end); }, "slab right");
+            }
+            threader.t_queue.waitUntilDone();
+        }
+    }
+
+    // Share of the correction obj takes from a contact with other, scaled so
+    // equal masses get gather_response of the overlap each
+    sf::Vector2f gatherPair (const Particle& obj, const Particle& other) {
+        sf::Vector2f v = obj.position - other.position;
+        float dist     = v.x * v.x + v.y * v.y;
+        float min_dist = obj.radius + other.radius;
+
+        if (dist < min_dist * min_dist && dist > 0.0f) {
+            dist = sqrt(dist);
+            float share = 2.0f * other.mass / (obj.mass + other.mass);
+            return v / dist * (share * gather_response * (min_dist - dist));
+        }
+        return {0.0f, 0.0f};
+    }
+
+    // Read-only over positions, so every particle can be resolved independently
+    sf::Vector2f gatherDisplacement (int obj_id) {
+        const Particle& obj  = objects[obj_id];
+        sf::Vector2f delta   = {0.0f, 0.0f};
+
+        for (int i = obj.gridx - 1; i <= obj.gridx + 1; i++) {
+            for (int j = obj.gridy - 1; j <= obj.gridy + 1; j++) {
+                for (int other_id : cellAt(i, j)) {
+                    if (other_id == obj_id) continue;
+                    delta += gatherPair(obj, objects[other_id]);
+                }
+            }
+        }
+        return delta;
+    }
 
-        // Left pass
-        for (int i = 0; i < threader.num_threads; i++) {
-            threader.t_queue.addTask([this, i, slice_size]{
-                int start = 2 * i * slice_size;
-                int end = start + slice_size;
-                checkCollisionsInSlice(start, end);
-            }); 
+    void checkCollisionsGather () {
+        PROFILE_SCOPE("collisions gather");
+        collision_deltas.resize(objects.size());
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) collision_deltas[i] = gatherDisplacement(i);
+        }, "gather");
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) objects[i].position += collision_deltas[i];
+        }, "apply deltas");
+    }
+
+    template<typename F>
+    void forEachNearby (int obj_id, int reach, F&& callback) {
+        const Particle& obj  = objects[obj_id];
+        for (int i = obj.gridx - reach; i <= obj.gridx + reach; i++) {
+            for (int j = obj.gridy - reach; j <= obj.gridy + reach; j++) {
+                for (int other_id : cellAt(i, j)) {
+                    if (other_id != obj_id) callback(other_id);
+                }
+            }
         }
-        if (slice_count * slice_size < num_cells) {
-            threader.t_queue.addTask([this, slice_count, slice_size, num_cells]{
-                checkCollisionsInSlice(slice_count * slice_size, num_cells);
-            }); 
+    }
+
+    // Lists hold every particle within grid_size + skin, so they stay valid
+    // until something has moved more than half the skin since the build
+    bool neighboursStale () {
+        if (neighbour_origin.size() != objects.size()) return true;
+        const float limit = 0.25f * neighbour_skin * neighbour_skin;
+        std::atomic<bool> stale = false;
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end && !stale; i++) {
+                sf::Vector2f v = objects[i].position - neighbour_origin[i];
+                if (v.x * v.x + v.y * v.y > limit) stale = true;
+            }
+        }, "neighbour check");
+        return stale;
+    }
+
+    void buildNeighbourLists () {
+        PROFILE_SCOPE("neighbour build");
+        const int   num_objects = objects.size();
+        const float cutoff      = grid_size + neighbour_skin;
+        const int   reach       = ceil(cutoff / grid_size);
+        neighbour_start.resize(num_objects + 1);
+        neighbour_origin.resize(num_objects);
+
+        // Count, prefix sum, then fill so the lists are one flat array
+        neighbour_start[0] = 0;
+        threader.parallel(num_objects, [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                const sf::Vector2f pos = objects[i].position;
+                int count = 0;
+                forEachNearby(i, reach, [&](int other_id) {
+                    sf::Vector2f v = pos - objects[other_id].position;
+                    if (v.x * v.x + v.y * v.y < cutoff * cutoff) count++;
+                });
+                neighbour_start[i + 1] = count;
+                neighbour_origin[i]    = pos;
+            }
+        }, "neighbour count");
+        for (int i = 0; i < num_objects; i++) neighbour_start[i + 1] += neighbour_start[i];
+        neighbour_ids.resize(neighbour_start[num_objects]);
+
+        threader.parallel(num_objects, [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                const sf::Vector2f pos = objects[i].position;
+                int slot = neighbour_start[i];
+                forEachNearby(i, reach, [&](int other_id) {
+                    sf::Vector2f v = pos - objects[other_id].position;
+                    if (v.x * v.x + v.y * v.y < cutoff * cutoff) neighbour_ids[slot++] = other_id;
+                });
+            }
+        }, "neighbour fill");
+        neighbour_builds++;
+    }
+
+    void checkCollisionsNeighbours () {
+        PROFILE_SCOPE("collisions neighbours");
+        if (neighboursStale()) buildNeighbourLists();
+        collision_deltas.resize(objects.size());
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) {
+                const Particle& obj = objects[i];
+                sf::Vector2f delta  = {0.0f, 0.0f};
+                for (int k = neighbour_start[i]; k < neighbour_start[i + 1]; k++) {
+                    delta += gatherPair(obj, objects[neighbour_ids[k]]);
+                }
+                collision_deltas[i] = delta;
+            }
+        }, "neighbour gather");
+        threader.parallel(objects.size(), [&](int start, int end) {
+            for (int i = start; i < end; i++) objects[i].position += collision_deltas[i];
+        }, "apply deltas");
+    }
+
+    // Smoothing length is two cells, so the neighbourhood is the 5x5 block
+    void gatherFluidNeighbourhood (int x, int y, bool with_state, FluidNeighbourhood& hood) {
+        hood.clear();
+        for (int i = x - 2; i <= x + 2; i++) {
+            for (int j = y - 2; j <= y + 2; j++) {
+                for (int id : cellAt(i, j)) {
+                    const Particle& obj = objects[id];
+                    hood.x.push_back(obj.position.x);
+                    hood.y.push_back(obj.position.y);
+                    hood.mass.push_back(obj.mass);
+                    if (!with_state) continue;
+                    const sf::Vector2f vel = obj.getVelocity() / (substep_dt * obj.stride);
+                    hood.vx.push_back(vel.x);
+                    hood.vy.push_back(vel.y);
+                    hood.density.push_back(fluid_density[id]);
+                    hood.pressure.push_back(fluid_pressure[id]);
+                }
+            }
         }
-        threader.t_queue.waitUntilDone();
-        // Right pass
-        for (int i = 0; i < threader.num_threads; i++) {
-            threader.t_queue.addTask([this, i, slice_size]{
-                int start = (2 * i + 1) * slice_size;
-                int end = start + slice_size;
-                checkCollisionsInSlice(start, end);
-            }); 
+    }
+
+    float fluidRestDensity (const FluidKernels& kernels) {
+        if (fluid_rest_density > 0.0f) return fluid_rest_density;
+        // Density of a hexagonal packing at contact distance
+        FluidNeighbourhood lattice;
+        const float spacing = grid_size;
+        for (int row = -3; row <= 3; row++) {
+            for (int col = -3; col <= 3; col++) {
+                lattice.x.push_back((col + 0.5f * (row & 1)) * spacing);
+                lattice.y.push_back(row * spacing * 0.8660254f);
+                lattice.mass.push_back(1.0f);
+            }
         }
-        threader.t_queue.waitUntilDone();
+        return fluid_rest_density = kernels.density(0.0f, 0.0f, lattice);
+    }
+
+    void applyFluidForces () {
+        PROFILE_SCOPE("fluid");
+        const FluidKernels kernels(2.0f * grid_size);
+        const float rest_density = fluidRestDensity(kernels);
+        fluid_density.resize(objects.size());
+        fluid_pressure.resize(objects.size());
+
+        forEachSlab([&](int lcol, int rcol) {
+            static thread_local FluidNeighbourhood hood;
+            forEachCellInSlice(lcol, rcol, [&](int x, int y, CellRange ids) {
+                gatherFluidNeighbourhood(x, y, false, hood);
+                for (int id : ids) {
+                    const Particle& obj = objects[id];
+                    const float density = kernels.density(obj.position.x, obj.position.y, hood);
+                    fluid_density[id]  = density;
+                    fluid_pressure[id] = std::max(0.0f, fluid_stiffness * (density - rest_density));
+                }
+            });
+        });
+        forEachSlab([&](int lcol, int rcol) {
+            static thread_local FluidNeighbourhood hood;
+            forEachCellInSlice(lcol, rcol, [&](int x, int y, CellRange ids) {
+                gatherFluidNeighbourhood(x, y, true, hood);
+                for (int id : ids) {
+                    Particle& obj = objects[id];
+                    const sf::Vector2f vel = obj.getVelocity() / (substep_dt * obj.stride);
+                    obj.accelerate(kernels.acceleration(obj.position.x, obj.position.y, vel.x, vel.y,
+                        fluid_density[id], fluid_pressure[id], fluid_viscosity, hood));
+                }
+            });
+        });
     }
 
     bool dotBounce (int obj_id, sf::Vector2f pos, float radius) {
@@ -217,32 +1268,26 @@ public:
         return false;
     }
 
-    void checkDotCollisions () { 
-        int num_cells_width  = window_width  / grid_size;
-        int num_cells_height = window_height / grid_size;
+    void checkDotCollisions () {
+        PROFILE_SCOPE("dots");
         for (ObstacleDot& dot : dot_obstacles) {
             const sf::Vector2f center = dot.position;
             const float offset = dot.radius + grid_size;
             
-            int left = (dot.position.x - offset) / grid_size;
-            int right = (dot.position.x + offset) / grid_size;
-            int top = (dot.position.y - offset) / grid_size;
-            int bottom = (dot.position.y + offset) / grid_size;
+            int left = floor((dot.position.x - offset) / grid_size);
+            int right = floor((dot.position.x + offset) / grid_size);
+            int top = floor((dot.position.y - offset) / grid_size);
+            int bottom = floor((dot.position.y + offset) / grid_size);
             for (int i = left; i <= right; i++) {
-                if (i < 0 || i >= num_cells_width) continue;
                 for (int j = top; j <= bottom; j++) {
-                    if (j < 0 || j >= num_cells_height) continue;
-                    if (!grid[i][j].size()) continue;
-                    for (int obj_id : grid[i][j]) dotBounce(obj_id, center, dot.radius);
+                    for (int obj_id : cellAt(i, j)) dotBounce(obj_id, center, dot.radius);
                 }
             }
+            for (int obj_id : large_objects) dotBounce(obj_id, center, dot.radius);
         }
     }
 
     void BoxBonce (int box_id) {
-        int num_cells_width  = window_width  / grid_size;
-        int num_cells_height = window_height / grid_size;
-
         ObstacleBox& box = box_obstacles[box_id];
         if (box.durability <= 0) return;
         // Get limits
@@ -269,119 +1314,248 @@ public:
 
         bool anyHit = false;
 
+        auto bounce = [&](int obj_id) {
+            bool hit = false;
+
+            hit |= dotBounce(obj_id, top_left, 0.0f);
+            hit |= dotBounce(obj_id, top_right, 0.0f);
+            hit |= dotBounce(obj_id, bottom_left, 0.0f);
+            hit |= dotBounce(obj_id, bottom_right, 0.0f);
+
+            Particle& obj = objects[obj_id];
+            const float  radius = obj.radius;
+            sf::Vector2f pos    = obj.position;
+            sf::Vector2f vel    = obj.getVelocity();
+            sf::Vector2f rotpos = anticlockwise.transformPoint(pos - center);
+            sf::Vector2f rotvel = anticlockwise.transformPoint(vel);
+
+            // Top edge
+            if ((-size.y - radius < rotpos.y && rotpos.y < 0) &&
+                (-size.x < rotpos.x && rotpos.x < size.x)) {
+                hit = true;
+                rotpos.y = -size.y - radius;
+                if (rotvel.y > 0) rotvel.y *= -dampening;
+            }
+            // Bottom edge
+            if ((0 < rotpos.y && rotpos.y < size.y + radius) &&
+                (-size.x < rotpos.x && rotpos.x < size.x)) {
+                hit = true;
+                rotpos.y = size.y + radius;
+                if (rotvel.y < 0) rotvel.y *= -dampening;
+            }   
+            // Left edge
+            if ((-size.x - radius < rotpos.x && rotpos.x < 0) &&
+                (-size.y < rotpos.y && rotpos.y < size.y)) {
+                hit = true;
+                rotpos.x = -size.x - radius;
+                if (rotvel.x > 0) rotvel.x *= -dampening;
+            }
+            // Right edge
+            if ((0 < rotpos.x && rotpos.x < size.x + radius) &&
+                (-size.y < rotpos.y && rotpos.y < size.y)) {
+                hit = true;
+                rotpos.x = size.x + radius;
+                if (rotvel.x < 0) rotvel.x *= -dampening;
+            }
+
+            obj.position = clockwise.transformPoint(rotpos) + center;
+            obj.setVelocity(clockwise.transformPoint(rotvel), 1.0f);
+
+            // Keyed by handle and substep, so the spot does not depend on the thread split
+            const uint64_t draw = 2 * substep_count;
+            if (hit && box.color == sf::Color::Green && box.durability > 0) {
+                obj.position = {CounterRNG::range(seed, obj.handle, draw, window_width - 190, window_width - 10),
+                                CounterRNG::range(seed, obj.handle, draw + 1, 50, 350)};
+                obj.setVelocity({0, 0}, 1.0f);
+            }
+            if (hit && box.color == sf::Color::Red && box.durability > 0) {
+                obj.position = {CounterRNG::range(seed, obj.handle, draw, 30, 2230),
+                                CounterRNG::range(seed, obj.handle, draw + 1, 10, 60)};
+                obj.setVelocity({0, 0}, 1.0f);
+            }
+            anyHit |= hit;
+        };
+
         // Check particles
         for (int i = left_limit; i <= right_limit; i++) {
-            if (i < 0 || i >= num_cells_width) continue;
             for (int j = upper_limit; j <= lower_limit; j++) {
-                if (j < 0 || j >= num_cells_height) continue;
-                if (!grid[i][j].size()) continue;
-                for (int obj_id : grid[i][j]) {
-                    bool hit = false;
-
-                    hit |= dotBounce(obj_id, top_left, 0.0f);
-                    hit |= dotBounce(obj_id, top_right, 0.0f);
-                    hit |= dotBounce(obj_id, bottom_left, 0.0f);
-                    hit |= dotBounce(obj_id, bottom_right, 0.0f);
-
-                    Particle& obj = objects[obj_id];
-                    const float  radius = obj.radius;
-                    sf::Vector2f pos    = obj.position;
-                    sf::Vector2f vel    = obj.getVelocity();
-                    sf::Vector2f rotpos = anticlockwise.transformPoint(pos - center);
-                    sf::Vector2f rotvel = anticlockwise.transformPoint(vel);
-
-                    // Top edge
-                    if ((-size.y - radius < rotpos.y && rotpos.y < 0) &&
-                        (-size.x < rotpos.x && rotpos.x < size.x)) {
-                        hit = true;
-                        rotpos.y = -size.y - radius;
-                        if (rotvel.y > 0) rotvel.y *= -dampening;
-                    }
-                    // Bottom edge
-                    if ((0 < rotpos.y && rotpos.y < size.y + radius) &&
-                        (-size.x < rotpos.x && rotpos.x < size.x)) {
-                        hit = true;
-                        rotpos.y = size.y + radius;
-                        if (rotvel.y < 0) rotvel.y *= -dampening;
-                    }   
-                    // Left edge
-                    if ((-size.x - radius < rotpos.x && rotpos.x < 0) &&
-                        (-size.y < rotpos.y && rotpos.y < size.y)) {
-                        hit = true;
-                        rotpos.x = -size.x - radius;
-                        if (rotvel.x > 0) rotvel.x *= -dampening;
-                    }
-                    // Right edge
-                    if ((0 < rotpos.x && rotpos.x < size.x + radius) &&
-                        (-size.y < rotpos.y && rotpos.y < size.y)) {
-                        hit = true;
-                        rotpos.x = size.x + radius;
-                        if (rotvel.x < 0) rotvel.x *= -dampening;
-                    }
-
-                    obj.position = clockwise.transformPoint(rotpos) + center;
-                    obj.setVelocity(clockwise.transformPoint(rotvel), 1.0f);
-
-                    if (hit && box.color == sf::Color::Green && box.durability > 0) {
-                        obj.position = {window_width - 10 - 180 * getRandom(), 50 + 300 * getRandom()};
-                        obj.setVelocity({0, 0}, 1.0f);
-                    }
-                    if (hit && box.color == sf::Color::Red && box.durability > 0) {
-                        obj.position = {30 + 2200 * getRandom(), 10 + 50 * getRandom()};
-                        obj.setVelocity({0, 0}, 1.0f);
-                    }
-                    anyHit |= hit;
-                }
+                for (int obj_id : cellAt(i, j)) bounce(obj_id);
             }
         }
+        for (int obj_id : large_objects) {
+            const Particle& obj = objects[obj_id];
+            if (obj.position.x + obj.radius < left_limit  * grid_size || obj.position.x - obj.radius > right_limit * grid_size ||
+                obj.position.y + obj.radius < upper_limit * grid_size || obj.position.y - obj.radius > lower_limit * grid_size) continue;
+            bounce(obj_id);
+        }
         if (anyHit && box.breakable && box.durability > 0) box.durability--;
     }
 
     void checkBoxCollisions () {
+        PROFILE_SCOPE("boxes");
         threader.parallel(box_obstacles.size(), [&](int start, int end) {
             for (int i = start; i < end; i++) BoxBonce(i);
         });
     }
 
     void applyGravity() {
+        PROFILE_SCOPE("gravity");
         for (auto& obj : objects) {
             obj.accelerate(gravity);
         }
     }
     
-    void updateObjectsThreaded (int start, int end, float dt) {
+    void updateObjectsThreaded (int start, int end, float dt, StatsAccumulator* acc = nullptr) {
+        int removed = 0;
         for (int i = start; i < end; i++) {
             Particle& obj = objects[i];
             int cur_gridx = obj.gridx, cur_gridy = obj.gridy;
-            obj.update(dt);
-            obj.gridx = obj.position.x / grid_size;
-            obj.gridy = obj.position.y / grid_size;
+            if (obj.stride == 1) obj.update(dt);
+            else if ((substep_index + 1) % obj.stride == 0) {
+                // Forces were added every substep, so average them over the step
+                obj.acceleration /= static_cast<float>(obj.stride);
+                obj.update(dt * obj.stride);
+            }
+            obj.gridx = floor(obj.position.x / grid_size);
+            obj.gridy = floor(obj.position.y / grid_size);
             sf::Vector2f vel = obj.getVelocity();
-            if (vel.x * vel.x + vel.y * vel.y > 2 * grid_size) obj.setVelocity({0.0f, 0.0f}, 1.0);
+            const float speed_sq = vel.x * vel.x + vel.y * vel.y;
+            if (!adaptive_substeps) {
+                if (speed_sq > 2 * grid_size) obj.setVelocity({0.0f, 0.0f}, 1.0);
+            } else if (speed_sq > grid_size * grid_size) {
+                // Only reached when max_substeps is not enough: cap at one cell
+                obj.setVelocity(vel * (grid_size / sqrt(speed_sq)), 1.0);
+            }
+
+            if (!obj.alive) continue;
+            if (obj.lifetime > 0.0f && (obj.lifetime -= dt) <= 0.0f) obj.alive = false;
+            for (const sf::FloatRect& sink : sinks) {
+                if (sink.contains(obj.position)) obj.alive = false;
+            }
+            if (cull_out_of_bounds &&
+                (obj.position.x < -cull_margin || obj.position.x > window_width  + cull_margin ||
+                 obj.position.y < -cull_margin || obj.position.y > window_height + cull_margin)) obj.alive = false;
+            if (!obj.alive) removed++;
+            else if (acc) stats.add(*acc, obj, obj.getVelocity() / (dt * obj.stride));
         }
+        if (removed) pending_removals += removed;
     }
 
+    // Statistics ride along with the last integration pass of each frame
     void updateObjects (float dt) {
+        PROFILE_SCOPE("integration");
+        const bool collect = stats.enabled && substep_index + 1 == static_cast<int>(substeps);
+        if (collect) stats.begin(threader.num_threads + 1, window_width, window_height);
         threader.parallel(objects.size(), [&](int start, int end) {
-            updateObjectsThreaded(start, end, dt);
+            updateObjectsThreaded(start, end, dt, collect && start < end ? &stats.acquire() : nullptr);
+        }, "integration");
+        if (collect) stats.end();
+    }
+
+    // Stable parallel stream compaction: count survivors per chunk, prefix sum
+    // the counts, then scatter each chunk into its slice of the scratch array
+    void compactObjects() {
+        PROFILE_SCOPE("compaction");
+        const int num_objects = objects.size();
+        const int num_chunks  = threader.num_threads * 4 + 1;
+        const int chunk_size  = (num_objects + num_chunks - 1) / num_chunks;
+        compact_alive.assign(num_chunks + 1, 0);
+        compact_dead.assign(num_chunks + 1, 0);
+
+        threader.parallel(num_chunks, [&](int start, int end) {
+            for (int c = start; c < end; c++) {
+                const int last = std::min(num_objects, (c + 1) * chunk_size);
+                for (int i = c * chunk_size; i < last; i++) {
+                    if (objects[i].alive) compact_alive[c + 1]++;
+                    else                  compact_dead[c + 1]++;
+                }
+            }
+        });
+        for (int c = 0; c < num_chunks; c++) {
+            compact_alive[c + 1] += compact_alive[c];
+            compact_dead[c + 1]  += compact_dead[c];
+        }
+
+        const int first_free = free_handles.size();
+        objects_scratch.resize(compact_alive[num_chunks]);
+        free_handles.resize(first_free + compact_dead[num_chunks]);
+        threader.parallel(num_chunks, [&](int start, int end) {
+            for (int c = start; c < end; c++) {
+                const int last = std::min(num_objects, (c + 1) * chunk_size);
+                int alive_slot = compact_alive[c], dead_slot = first_free + compact_dead[c];
+                for (int i = c * chunk_size; i < last; i++) {
+                    const Particle& obj = objects[i];
+                    if (!obj.alive) {
+                        handle_index[obj.handle]   = -1;
+                        free_handles[dead_slot++] = obj.handle;
+                        continue;
+                    }
+                    Particle& moved = objects_scratch[alive_slot];
+                    moved    = obj;
+                    moved.id = alive_slot;
+                    handle_index[obj.handle] = alive_slot++;
+                }
+            }
         });
+        objects.swap(objects_scratch);
+        pending_removals = 0;
+        // Indices shifted, so cached per-index neighbour lists are meaningless
+        neighbour_origin.clear();
     }
 
     void updateObstacles(float dt) {
+        PROFILE_SCOPE("obstacles");
         for (auto& dot : dot_obstacles) dot.update(dt);
         for (auto& box : box_obstacles) box.update(dt);
     }
 
+    // Both backends counting-sort the ids into one flat array, so rebuilding
+    // allocates nothing once the particle count stops growing
     void updateGrid() {
-        int num_cells_width  = window_width  / grid_size;
-        int num_cells_height = window_height / grid_size;
-        for (int i = 0; i < num_cells_width; i++)
-            for (int j = 0; j < num_cells_height; j++)
-                grid[i][j].clear();
+        PROFILE_SCOPE("grid");
+        const int num_objects = objects.size();
+        const int num_cells   = grid_width * grid_height;
+        if (sparse_grid) hash_grid.build(objects);
+        else {
+            grid_start.assign(num_cells + 1, 0);
+            grid_cell.resize(num_objects);
+        }
+        large_objects.clear();
 
-        for (Particle& obj : objects) {
-            if (obj.gridx < 0 || obj.gridy < 0 || obj.gridx >= num_cells_width || obj.gridy >= num_cells_height) continue;
-            grid[obj.gridx][obj.gridy].push_back(obj.id);
+        for (int i = 0; i < num_objects; i++) {
+            const Particle& obj = objects[i];
+            if (obj.level > 0) {
+                large_objects.push_back(i);
+                if (!sparse_grid) grid_cell[i] = -1;
+                continue;
+            }
+            if (sparse_grid) continue;
+            if (obj.gridx < 0 || obj.gridy < 0 || obj.gridx >= grid_width || obj.gridy >= grid_height) {
+                grid_cell[i] = -1;
+                continue;
+            }
+            grid_cell[i] = obj.gridx * grid_height + obj.gridy;
+            grid_start[grid_cell[i]]++;
+        }
+        for (GridLevel& level : grid_levels) {
+            level.sparse = sparse_grid;
+            level.build(objects, large_objects);
+        }
+        if (sparse_grid) return;
+
+        // Counts become starts, the scatter advances each start to its cell's
+        // end, and shifting by one cell turns those back into starts
+        int start = 0;
+        for (int& count : grid_start) {
+            const int cell_count = count;
+            count  = start;
+            start += cell_count;
+        }
+        grid_ids.resize(start);
+        for (int i = 0; i < num_objects; i++) {
+            if (grid_cell[i] >= 0) grid_ids[grid_start[grid_cell[i]]++] = i;
         }
+        for (int cell = num_cells; cell > 0; cell--) grid_start[cell] = grid_start[cell - 1];
+        grid_start[0] = 0;
     }
 };
\ No newline at end of file
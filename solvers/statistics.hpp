@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <SFML/Graphics.hpp>
+#include "../particle.hpp"
+
+// Everything gathered about one frame. Each integration task fills its own
+// copy, and the copies are summed once the pass is done
+struct StatsAccumulator {
+    std::vector<int> bins;       // between consecutive bin edges
+    std::vector<int> tiles;      // particles per density tile
+    std::vector<int> speeds;     // speed histogram
+    double           kinetic_energy = 0.0;
+    float            max_speed      = 0.0f;
+    int              count          = 0;
+
+    void reset(int num_bins, int num_tiles, int num_speeds) {
+        bins.assign(num_bins, 0);
+        tiles.assign(num_tiles, 0);
+        speeds.assign(num_speeds, 0);
+        kinetic_energy = 0.0;
+        max_speed      = 0.0f;
+        count          = 0;
+    }
+
+    void merge(const StatsAccumulator& other) {
+        for (size_t i = 0; i < bins.size(); i++)   bins[i]   += other.bins[i];
+        for (size_t i = 0; i < tiles.size(); i++)  tiles[i]  += other.tiles[i];
+        for (size_t i = 0; i < speeds.size(); i++) speeds[i] += other.speeds[i];
+        kinetic_energy += other.kinetic_energy;
+        max_speed       = std::max(max_speed, other.max_speed);
+        count          += other.count;
+    }
+};
+
+struct SolverStats {
+    bool               enabled     = false;
+    std::vector<float> bin_edges;                // sorted x positions, e.g. galton dividers
+    sf::FloatRect      bin_region;               // only particles inside are binned, empty bins all
+    float              tile_size   = 64.0f;
+    float              speed_limit = 1000.0f;    // px/s covered by the speed histogram
+    int                speed_bins  = 32;
+
+    StatsAccumulator   frame;                    // results of the last frame
+    std::vector<StatsAccumulator> partials;
+    std::atomic<int>   next_partial{0};
+    int                tiles_x = 0, tiles_y = 0;
+
+    void begin(int max_tasks, float width, float height) {
+        tiles_x = std::ceil(width / tile_size);
+        tiles_y = std::ceil(height / tile_size);
+        partials.resize(max_tasks);
+        for (StatsAccumulator& partial : partials) {
+            partial.reset(bin_edges.size() + 1, tiles_x * tiles_y, speed_bins);
+        }
+        next_partial = 0;
+    }
+
+    // One accumulator per task, handed out without locking
+    StatsAccumulator& acquire() {
+        return partials[next_partial++];
+    }
+
+    void end() {
+        frame.reset(bin_edges.size() + 1, tiles_x * tiles_y, speed_bins);
+        for (int i = 0; i < next_partial; i++) frame.merge(partials[i]);
+    }
+
+    void add(StatsAccumulator& acc, const Particle& obj, sf::Vector2f velocity) const {
+        const float speed_sq = velocity.x * velocity.x + velocity.y * velocity.y;
+        const float speed    = std::sqrt(speed_sq);
+        acc.kinetic_energy += 0.5f * obj.mass * speed_sq;
+        acc.max_speed       = std::max(acc.max_speed, speed);
+        acc.count++;
+        acc.speeds[std::min(speed_bins - 1, static_cast<int>(speed / speed_limit * speed_bins))]++;
+
+        const int tx = std::floor(obj.position.x / tile_size);
+        const int ty = std::floor(obj.position.y / tile_size);
+        if (tx >= 0 && ty >= 0 && tx < tiles_x && ty < tiles_y) acc.tiles[tx * tiles_y + ty]++;
+
+        if (bin_region.width > 0.0f && !bin_region.contains(obj.position)) return;
+        acc.bins[std::upper_bound(bin_edges.begin(), bin_edges.end(), obj.position.x) - bin_edges.begin()]++;
+    }
+};
@@ -1,33 +1,74 @@
 #pragma once
 #include <functional>
-#include <queue>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include "utils/trace.hpp"
+#if defined(PARTICLE_PERF_COUNTERS) || defined(PARTICLE_ALLOC_TRACKING)
+#include "utils/profiler.hpp"
+#define PARTICLE_TASK_PHASES
+#endif
 
+// One pending task. With perf counters or allocation tracking it also
+// carries the phase open on the thread that queued it, so concurrent solvers
+// charge their own phases
+struct QueuedTask {
+    std::function<void()> callback = nullptr;
+    const char*           label    = nullptr;
+#ifdef PARTICLE_TASK_PHASES
+    int                   phase    = -1;
+#endif
+};
+
+// Pending tasks sit in a ring that only grows when more are queued at once
+// than ever before, so steady-state frames queue tasks without allocating.
+// Tasks should capture at most two pointers' worth, which std::function
+// stores inline
 struct TaskQueue {
-    std::queue<std::function<void()>> tasks;
-    std::mutex                        mutex_;
-    std::atomic<int>                  remaining_tasks = 0;
+    std::vector<QueuedTask> tasks = std::vector<QueuedTask>(64);
+    size_t                  head  = 0;
+    size_t                  tail  = 0;
+    std::mutex              mutex_;
+    std::atomic<int>        remaining_tasks = 0;
 
-    void addTask(std::function<void()>&& callback) {
+    void addTask(std::function<void()>&& callback, const char* label = "task") {
         std::lock_guard<std::mutex> lock_guard{mutex_};
-        tasks.push(std::move(callback));
+        if (tail - head == tasks.size()) grow();
+        QueuedTask& task = tasks[tail % tasks.size()];
+        task.callback = std::move(callback);
+        task.label    = label;
+#ifdef PARTICLE_TASK_PHASES
+        task.phase    = Profiler::threadPhase();
+#endif
+        tail++;
         remaining_tasks++;
     }
 
-    void getTask (std::function<void()>& task) {
+    void getTask (QueuedTask& task) {
         std::lock_guard<std::mutex> lock_guard{mutex_};
-        if (tasks.empty()) return;
-        task = std::move(tasks.front());
-        tasks.pop();
+        if (head == tail) return;
+        task = std::move(tasks[head % tasks.size()]);
+        tasks[head % tasks.size()].callback = nullptr;
+        head++;
+    }
+
+    // Called with the lock held and the ring full
+    void grow() {
+        const size_t count = tail - head;
+        std::vector<QueuedTask> grown(2 * tasks.size());
+        for (size_t i = 0; i < count; i++) grown[i] = std::move(tasks[(head + i) % tasks.size()]);
+        tasks.swap(grown);
+        head = 0;
+        tail = count;
     }
 
     void waitUntilDone() const {
+        TRACE_BEGIN(wait_begin);
         while (remaining_tasks > 0) {
            std::this_thread::yield();
         }
+        TRACE_END("wait", wait_begin);
     }
 
     void completeTask() {
@@ -38,7 +79,7 @@ struct TaskQueue {
 struct Thread {
     int                   id      = 0;
     std::thread           cur_thread;
-    std::function<void()> task    = nullptr;
+    QueuedTask            task;
     bool                  running = true;
     TaskQueue*            t_queue = nullptr;
     
@@ -54,11 +95,27 @@ struct Thread {
     void run() {
         while (running) {
             t_queue->getTask(task);
-            if (task == nullptr) std::this_thread::yield();
+            if (task.callback == nullptr) std::this_thread::yield();
             else {
-                task();
+                TRACE_BEGIN(task_begin);
+#ifdef PARTICLE_ALLOC_TRACKING
+                // Allocations inside the task belong to the phase that queued it
+                Profiler::threadPhase() = task.phase;
+#endif
+#ifdef PARTICLE_PERF_COUNTERS
+                // Charge this worker's counters to the phase that queued the task
+                const CounterValues counters_start = PerfCounters::local().read();
+#endif
+                task.callback();
+#ifdef PARTICLE_PERF_COUNTERS
+                Profiler::get().addCounters(task.phase, PerfCounters::local().read() - counters_start);
+#endif
+#ifdef PARTICLE_ALLOC_TRACKING
+                Profiler::threadPhase() = -1;
+#endif
+                TRACE_END(task.label, task_begin);
                 t_queue->completeTask();
-                task = nullptr;
+                task.callback = nullptr;
             }
         }
     }
@@ -69,6 +126,8 @@ struct Thread {
     }
 };
 
+// A Threader with zero threads runs everything inline on the calling thread,
+// so one can be shared by solvers that each already own a worker
 struct Threader {
     TaskQueue t_queue;
     int num_threads = 1;
@@ -82,16 +141,31 @@ struct Threader {
             threads.emplace_back(t_queue, i);
     }
 
-    void parallel(int num_obj, std::function<void(int start, int end)>&& callback) {
+    ~Threader() {
+        for (Thread& thread : threads) {
+            thread.stop();
+        }
+    }
+
+    // Templated so the callback is never copied into a std::function; each
+    // task only holds its range and a reference to it
+    template<typename F>
+    void parallel(int num_obj, F&& callback, const char* label = "parallel") {
+        if (num_threads == 0) {
+            callback(0, num_obj);
+            return;
+        }
         int slice_size = num_obj / num_threads;
         for (int i = 0; i < num_threads; i++) {
             int start = i * slice_size;
             int end = start + slice_size;
-            t_queue.addTask([start, end, &callback](){ callback(start, end);});
+            t_queue.addTask([start, end, &callback](){ callback(start, end);}, label);
         }
         if (slice_size * num_threads < num_obj) {
+            TRACE_BEGIN(rest_begin);
             int start = slice_size * num_threads;
             callback(start, num_obj);
+            TRACE_END(label, rest_begin);
         }
         t_queue.waitUntilDone();
     }
@@ -0,0 +1,145 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "profiler.hpp"
+
+// Counts heap allocations per thread and per profiled phase, and what each
+// frame added. Only the counting is here; the global operator new/delete that
+// feed it are defined below under PARTICLE_ALLOC_TRACKING, so include this
+// header from exactly one translation unit of the program.
+struct AllocTracker {
+    static constexpr int max_threads = 128;
+    static constexpr int no_phase    = Profiler::max_phases; // allocations outside any phase
+
+    struct Tally {
+        std::atomic<int64_t> count{0};
+        std::atomic<int64_t> bytes{0};
+        std::atomic<int64_t> frees{0};
+    };
+
+    Tally             threads[max_threads];
+    Tally             phases[Profiler::max_phases + 1];
+    std::atomic<int>  num_threads{0};
+    std::atomic<bool> enabled{false}; // off until the caller is done loading
+
+    // Counts at the end of the previous frame, and what the last frame added
+    int64_t thread_mark[max_threads]               = {};
+    int64_t phase_mark[Profiler::max_phases + 1]   = {};
+    int64_t frame_threads[max_threads]             = {};
+    int64_t frame_phases[Profiler::max_phases + 1] = {};
+    int64_t frame_count       = 0;
+    int64_t frame_bytes       = 0;
+    int64_t frame_frees       = 0;
+    int64_t bytes_mark        = 0;
+    int64_t frees_mark        = 0;
+    int     frames            = 0;
+    int     allocating_frames = 0;
+
+    static AllocTracker& get() {
+        static AllocTracker tracker;
+        return tracker;
+    }
+
+    static int threadSlot() {
+        thread_local int slot = -1;
+        if (slot < 0) slot = std::min(get().num_threads++, max_threads - 1);
+        return slot;
+    }
+
+    void record(size_t size) {
+        if (!enabled.load(std::memory_order_relaxed)) return;
+        const int phase = Profiler::threadPhase();
+        Tally& thread = threads[threadSlot()];
+        Tally& owner  = phases[phase < 0 ? no_phase : phase];
+        thread.count.fetch_add(1, std::memory_order_relaxed);
+        thread.bytes.fetch_add(size, std::memory_order_relaxed);
+        owner.count.fetch_add(1, std::memory_order_relaxed);
+        owner.bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void release() {
+        if (!enabled.load(std::memory_order_relaxed)) return;
+        const int phase = Profiler::threadPhase();
+        threads[threadSlot()].frees.fetch_add(1, std::memory_order_relaxed);
+        phases[phase < 0 ? no_phase : phase].frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Called once per frame by the main loop
+    void endFrame() {
+        if (!enabled) return;
+        frame_count = 0;
+        int64_t bytes = 0, frees = 0;
+        for (int i = 0; i < std::min(num_threads.load(), max_threads); i++) {
+            const int64_t count = threads[i].count;
+            frame_threads[i] = count - thread_mark[i];
+            thread_mark[i]   = count;
+            frame_count     += frame_threads[i];
+            bytes           += threads[i].bytes;
+            frees           += threads[i].frees;
+        }
+        for (int i = 0; i <= no_phase; i++) {
+            const int64_t count = phases[i].count;
+            frame_phases[i] = count - phase_mark[i];
+            phase_mark[i]   = count;
+        }
+        frame_bytes = bytes - bytes_mark;
+        bytes_mark  = bytes;
+        frame_frees = frees - frees_mark;
+        frees_mark  = frees;
+        frames++;
+        if (frame_count > 0) allocating_frames++;
+    }
+
+    // Prints without allocating, so printing does not show up in the next frame
+    void print(FILE* file) const {
+        std::fprintf(file, "allocations %lld (%lld bytes) and %lld frees last frame, %d of %d frames allocated\n",
+                     static_cast<long long>(frame_count), static_cast<long long>(frame_bytes),
+                     static_cast<long long>(frame_frees), allocating_frames, frames);
+        const Profiler& profiler = Profiler::get();
+        for (int i = 0; i <= no_phase; i++) {
+            if (frame_phases[i] == 0) continue;
+            std::fprintf(file, "  %-18s %6lld\n", i == no_phase ? "(no phase)" : profiler.phases[i].name,
+                         static_cast<long long>(frame_phases[i]));
+        }
+        for (int i = 0; i < std::min(num_threads.load(), max_threads); i++) {
+            if (frame_threads[i] == 0) continue;
+            std::fprintf(file, "  thread %-11d %6lld\n", i, static_cast<long long>(frame_threads[i]));
+        }
+    }
+};
+
+#ifdef PARTICLE_ALLOC_TRACKING
+void* operator new(size_t size) {
+    AllocTracker::get().record(size);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr) AllocTracker::get().release();
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+#define ALLOC_FRAME() AllocTracker::get().endFrame()
+#else
+#define ALLOC_FRAME()
+#endif
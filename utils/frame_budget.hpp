@@ -0,0 +1,106 @@
+#pragma once
+#include <algorithm>
+#include <SFML/System.hpp>
+#include "../solvers/solver_final.hpp"
+#include "../renderers/renderer_fast.hpp"
+
+// One rung of the degradation ladder. Cheap visual losses come first, and
+// substep cuts come last because they soften the physics
+struct QualityLevel {
+    const char* name;
+    bool        trails;
+    float       resolution;
+    float       substep_scale;
+};
+
+static constexpr QualityLevel quality_levels[] = {
+    {"full",           true,  1.0f,  1.0f},
+    {"no trails",      false, 1.0f,  1.0f},
+    {"75% resolution", false, 0.75f, 1.0f},
+    {"75% substeps",   false, 0.75f, 0.75f},
+    {"50% resolution", false, 0.5f,  0.75f},
+    {"50% substeps",   false, 0.5f,  0.5f},
+};
+static constexpr int num_quality_levels = sizeof(quality_levels) / sizeof(QualityLevel);
+
+struct FrameBudgetStats {
+    float       update_ms   = 0.0f;
+    float       render_ms   = 0.0f;
+    float       average_ms  = 0.0f; // smoothed update + render
+    int         level       = 0;
+    const char* level_name  = quality_levels[0].name;
+    int         downgrades  = 0;
+    int         upgrades    = 0;
+    int         last_change = -1;   // frame of the last decision
+    int         frame       = 0;
+};
+
+// Measures solver and render cost each frame and walks the quality ladder to
+// stay inside budget_ms. Degrades after degrade_frames over the high mark,
+// recovers only after recover_frames under the low mark
+struct FrameBudget {
+    float            budget_ms      = 1000.0f / 60;
+    float            high_mark      = 1.0f;
+    float            low_mark       = 0.7f;
+    int              degrade_frames = 5;
+    int              recover_frames = 120;
+    float            smoothing      = 0.2f;
+
+    Solver&          solver;
+    Renderer&        renderer;
+    FrameBudgetStats stats;
+    int              base_substeps;
+    int              over_frames    = 0;
+    int              under_frames   = 0;
+    sf::Clock        clock;
+
+    FrameBudget(Solver& solver_, Renderer& renderer_, float budget_ms_ = 1000.0f / 60)
+        : budget_ms{budget_ms_}
+        , solver{solver_}
+        , renderer{renderer_}
+        , base_substeps{static_cast<int>(solver_.adaptive_substeps ? solver_.max_substeps : solver_.substeps)}
+    {}
+
+    void startUpdate() {
+        clock.restart();
+    }
+
+    void startRender() {
+        stats.update_ms = clock.restart().asMicroseconds() / 1000.0f;
+    }
+
+    void endFrame() {
+        stats.render_ms = clock.restart().asMicroseconds() / 1000.0f;
+        const float frame_ms = stats.update_ms + stats.render_ms;
+        stats.average_ms = stats.frame == 0 ? frame_ms : stats.average_ms + smoothing * (frame_ms - stats.average_ms);
+        stats.frame++;
+
+        over_frames  = stats.average_ms > budget_ms * high_mark ? over_frames + 1 : 0;
+        under_frames = stats.average_ms < budget_ms * low_mark ? under_frames + 1 : 0;
+        if (over_frames >= degrade_frames && stats.level + 1 < num_quality_levels) {
+            setLevel(stats.level + 1);
+            stats.downgrades++;
+        } else if (under_frames >= recover_frames && stats.level > 0) {
+            setLevel(stats.level - 1);
+            stats.upgrades++;
+        }
+    }
+
+    void setLevel(int level) {
+        const QualityLevel& quality = quality_levels[level];
+        renderer.draw_trails = quality.trails;
+        renderer.resolution  = quality.resolution;
+
+        const int substeps = std::max(1, static_cast<int>(base_substeps * quality.substep_scale + 0.5f));
+        if (solver.adaptive_substeps) {
+            solver.max_substeps = std::max(substeps, solver.min_substeps);
+        } else {
+            solver.setSubsteps(substeps);
+        }
+
+        stats.level       = level;
+        stats.level_name  = quality.name;
+        stats.last_change = stats.frame;
+        over_frames = under_frames = 0;
+    }
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <utility>
+#include "../particle.hpp"
+
+// View over the particle ids stored in one grid cell
+struct CellRange {
+    const int* first = nullptr;
+    const int* last  = nullptr;
+
+    CellRange() = default;
+    CellRange(const int* first_, const int* last_)
+        : first{first_}
+        , last{last_}
+    {}
+    CellRange(const std::vector<int>& ids)
+        : first{ids.data()}
+        , last{ids.data() + ids.size()}
+    {}
+
+    const int* begin() const { return first; }
+    const int* end()   const { return last; }
+    int  size()  const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+// Spatial hash that only stores occupied cells. Cells live in an open-addressing
+// table keyed by cell coordinate, and the ids are counting-sorted into one flat
+// array, so rebuilding allocates nothing once the particle count stops growing.
+// Cells are kept ordered by column, so a slab of columns is one contiguous run.
+struct HashGrid {
+    struct Cell {
+        int x = 0, y = 0;
+        int start = 0, count = 0;
+        int slot = 0;
+    };
+
+    // Key of cell (INT_MAX, INT_MAX), which no float position reaches. All ones
+    // would be cell (-1, -1)
+    static constexpr uint64_t empty_key = 0x7fffffff7fffffffull;
+
+    std::vector<uint64_t> keys;
+    std::vector<int>      slots;
+    std::vector<Cell>     cells;
+    std::vector<Cell>     sorted_cells;
+    std::vector<int>      column_start;
+    std::vector<int>      object_cell; // table slot of each object's cell, -1 if not hashed
+    std::vector<int>      ids;
+    int                   min_x = 0, max_x = -1;
+    int                   min_y = 0, max_y = -1;
+
+    static uint64_t key(int x, int y) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y);
+    }
+
+    static uint64_t hash(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        return k;
+    }
+
+    // Keep the load factor at or below a half
+    void reserve(int num_objects) {
+        size_t capacity = 64;
+        while (capacity < 2 * static_cast<size_t>(num_objects)) capacity <<= 1;
+        if (keys.size() < capacity) {
+            keys.assign(capacity, empty_key);
+            slots.resize(capacity);
+            cells.clear();
+            cells.reserve(num_objects);
+            sorted_cells.reserve(num_objects);
+        }
+    }
+
+    void clear() {
+        for (const Cell& cell : cells) keys[cell.slot] = empty_key;
+        cells.clear();
+        min_x = min_y = INT_MAX;
+        max_x = max_y = INT_MIN;
+    }
+
+    int find(int x, int y) const {
+        if (keys.empty()) return -1;
+        const uint64_t k    = key(x, y);
+        const size_t   mask = keys.size() - 1;
+        for (size_t h = hash(k) & mask;; h = (h + 1) & mask) {
+            if (keys[h] == k) return slots[h];
+            if (keys[h] == empty_key) return -1;
+        }
+    }
+
+    int insert(int x, int y) {
+        const uint64_t k    = key(x, y);
+        const size_t   mask = keys.size() - 1;
+        size_t h = hash(k) & mask;
+        while (keys[h] != empty_key) {
+            if (keys[h] == k) return slots[h];
+            h = (h + 1) & mask;
+        }
+        keys[h]  = k;
+        slots[h] = cells.size();
+        Cell& cell = cells.emplace_back();
+        cell.x    = x;
+        cell.y    = y;
+        cell.slot = h;
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        return slots[h];
+    }
+
+    CellRange at(int x, int y) const {
+        int c = find(x, y);
+        if (c < 0) return {};
+        const int* first = ids.data() + cells[c].start;
+        return {first, first + cells[c].count};
+    }
+
+    // Index range [first, last) of the cells in columns [lcol, rcol)
+    std::pair<int, int> columns(int lcol, int rcol) const {
+        auto by_column = [](const Cell& cell, int x) { return cell.x < x; };
+        const int first = std::lower_bound(cells.begin(), cells.end(), lcol, by_column) - cells.begin();
+        const int last  = std::lower_bound(cells.begin() + first, cells.end(), rcol, by_column) - cells.begin();
+        return {first, last};
+    }
+
+    // Counting sort on the column when the occupied columns are not much
+    // sparser than the cells, a comparison sort otherwise
+    void sortByColumn() {
+        if (cells.empty()) return;
+        const int64_t num_cols = static_cast<int64_t>(max_x) - min_x + 1;
+        if (num_cols <= 4 * static_cast<int64_t>(cells.size()) + 64) {
+            column_start.assign(num_cols + 1, 0);
+            for (const Cell& cell : cells) column_start[cell.x - min_x + 1]++;
+            for (int64_t i = 0; i < num_cols; i++) column_start[i + 1] += column_start[i];
+            sorted_cells.resize(cells.size());
+            for (const Cell& cell : cells) sorted_cells[column_start[cell.x - min_x]++] = cell;
+            cells.swap(sorted_cells);
+        } else {
+            std::sort(cells.begin(), cells.end(), [](const Cell& a, const Cell& b) { return a.x < b.x; });
+        }
+        for (int c = 0; c < static_cast<int>(cells.size()); c++) slots[cells[c].slot] = c;
+    }
+
+    // cell_of(i, x, y) returns false to leave object i out of the grid
+    template<typename F>
+    void build(int num_objects, F&& cell_of) {
+        reserve(num_objects);
+        clear();
+        object_cell.resize(num_objects);
+        ids.resize(num_objects);
+
+        for (int i = 0; i < num_objects; i++) {
+            int x, y;
+            if (!cell_of(i, x, y)) {
+                object_cell[i] = -1;
+                continue;
+            }
+            Cell& cell = cells[insert(x, y)];
+            cell.count++;
+            object_cell[i] = cell.slot;
+        }
+        sortByColumn();
+
+        int start = 0;
+        for (Cell& cell : cells) {
+            cell.start = start;
+            start     += cell.count;
+            cell.count = 0;
+        }
+        for (int i = 0; i < num_objects; i++) {
+            if (object_cell[i] < 0) continue;
+            Cell& cell = cells[slots[object_cell[i]]];
+            ids[cell.start + cell.count++] = i;
+        }
+    }
+
+    // Base level particles, by the cell they were last assigned
+    void build(const std::vector<Particle>& objects) {
+        build(objects.size(), [&](int i, int& x, int& y) {
+            const Particle& obj = objects[i];
+            x = obj.gridx;
+            y = obj.gridy;
+            return obj.level == 0;
+        });
+    }
+};
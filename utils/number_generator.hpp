@@ -1,138 +1,41 @@
 #pragma once
-#include <random>
+#include <cstdint>
 
-class NumberGenerator {
-    protected:
-        std::random_device rd;
-        std::mt19937 gen;
-
-        NumberGenerator()
-                : gen(rd())
-        {}
-};
-
-
-template<typename T>
-class RealNumberGenerator : public NumberGenerator {
-private:
-    std::uniform_real_distribution<T> dis;
-
-public:
-    RealNumberGenerator()
-            : NumberGenerator()
-            , dis(0.0f, 1.0f)
-    {}
-
-    // random_device is not copyable
-    RealNumberGenerator(const RealNumberGenerator<T>& right)
-            : NumberGenerator()
-            , dis(right.dis)
-    {}
-
-    float get() {
-        return dis(gen);
+// Counter-based generator: every value is a pure function of its key, so any
+// worker can draw without shared state and results do not depend on how the
+// work was split. Two-part keys (seed, index) hash like SplitMix64; three-part
+// keys (seed, stream, counter) first derive a key per stream, e.g. per particle
+struct CounterRNG {
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
     }
 
-    float getUnder(T max) {
-        return get() * max;
+    static uint64_t hash(uint64_t seed, uint64_t index) {
+        return mix(seed + index * 0x9e3779b97f4a7c15ull);
     }
 
-    float getRange(T min, T max) {
-        return min + get() * (max - min);
+    static uint64_t hash(uint64_t seed, uint64_t stream, uint64_t counter) {
+        return hash(hash(seed, stream), counter);
     }
 
-    float getRange(T width) {
-        return getRange(-width * 0.5f, width * 0.5f);
+    // Top 24 bits mapped to [0, 1)
+    static float unit(uint64_t seed, uint64_t index) {
+        return (hash(seed, index) >> 40) * (1.0f / 16777216.0f);
     }
-};
-
-
-template<typename T>
-class RNG {
-private:
-    static RealNumberGenerator<T> gen;
 
-public:
-    static T get() {
-        return gen.get();
+    static float unit(uint64_t seed, uint64_t stream, uint64_t counter) {
+        return unit(hash(seed, stream), counter);
     }
 
-    static float getUnder(T max) {
-        return gen.getUnder(max);
+    // unit(seed, stream, counter) mapped to [min, max)
+    static float range(uint64_t seed, uint64_t stream, uint64_t counter, float min, float max) {
+        return min + unit(seed, stream, counter) * (max - min);
     }
 
-    static uint64_t getUintUnder(uint64_t max) {
-        return static_cast<uint64_t>(gen.getUnder(static_cast<float>(max) + 1.0f));
-    }
-
-    static float getRange(T min, T max) {
-        return gen.getRange(min, max);
-    }
-
-    static float getRange(T width) {
-        return gen.getRange(width);
-    }
-
-    static float getFullRange(T width) {
-        return gen.getRange(static_cast<T>(2.0f) * width);
-    }
-
-    static bool proba(float threshold) {
-        return get() < threshold;
+    // unit(seed, first + i) for i < count. No loop-carried state, so it vectorizes
+    static void fill(uint64_t seed, uint64_t first, float* out, int count) {
+        for (int i = 0; i < count; i++) out[i] = unit(seed, first + i);
     }
 };
-
-using RNGf = RNG<float>;
-
-template<typename T>
-RealNumberGenerator<T> RNG<T>::gen = RealNumberGenerator<T>();
-
-
-template<typename T>
-class IntegerNumberGenerator : public NumberGenerator
-{
-public:
-    IntegerNumberGenerator()
-            : NumberGenerator()
-    {}
-
-    // random_device is not copyable
-    IntegerNumberGenerator(const IntegerNumberGenerator<T>& right)
-            : NumberGenerator()
-    {}
-
-    T getUnder(T max) {
-        std::uniform_int_distribution<std::mt19937::result_type> dist(0, max);
-        return dist(gen);
-    }
-
-    T getRange(T min, T max) {
-        std::uniform_int_distribution<std::mt19937::result_type> dist(min, max);
-        return dist(gen);
-    }
-};
-
-
-template<typename T>
-class RNGi
-{
-private:
-    static IntegerNumberGenerator<T> gen;
-
-public:
-    static T getUnder(T max) {
-        return gen.getUnder(max);
-    }
-
-    static T getRange(T min, T max) {
-        return gen.getRange(min, max);
-    }
-};
-
-template<typename T>
-IntegerNumberGenerator<T> RNGi<T>::gen;
-
-using RNGi32 = RNGi<int32_t>;
-using RNGi64 = RNGi<int64_t>;
-using RNGu32 = RNGi<uint32_t>;
-using RNGu64 = RNGi<uint64_t>;
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum CounterKind { counter_cycles, counter_instructions, counter_cache_misses, counter_branch_misses, num_counters };
+
+static constexpr const char* counter_names[num_counters] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+struct CounterValues {
+    int64_t values[num_counters] = {};
+
+    CounterValues operator-(const CounterValues& other) const {
+        CounterValues result;
+        for (int i = 0; i < num_counters; i++) result.values[i] = values[i] - other.values[i];
+        return result;
+    }
+};
+
+// One counter group per thread, counting only that thread in user space.
+// Counters the kernel refuses (no PMU in a VM, perf_event_paranoid, not
+// Linux) are left out and read as zero, so callers never need to check
+struct PerfCounters {
+    int  fds[num_counters]   = {-1, -1, -1, -1};
+    int  slots[num_counters] = {-1, -1, -1, -1}; // position in the group read
+    int  leader    = -1;
+    int  opened    = 0;
+
+#ifdef __linux__
+    PerfCounters() {
+        const uint64_t configs[num_counters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int i = 0; i < num_counters; i++) {
+            perf_event_attr attr{};
+            attr.size           = sizeof(attr);
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.config         = configs[i];
+            attr.read_format    = PERF_FORMAT_GROUP;
+            attr.disabled       = leader < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0) continue;
+            if (leader < 0) leader = fd;
+            fds[i]   = fd;
+            slots[i] = opened++;
+        }
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    CounterValues read() const {
+        CounterValues result;
+        if (leader < 0) return result;
+        uint64_t data[1 + num_counters] = {};
+        if (::read(leader, data, sizeof(data)) <= 0) return result;
+        for (int i = 0; i < num_counters; i++) {
+            if (slots[i] >= 0) result.values[i] = data[1 + slots[i]];
+        }
+        return result;
+    }
+#else
+    CounterValues read() const {
+        return {};
+    }
+#endif
+
+    bool available() const {
+        return opened > 0;
+    }
+
+    static PerfCounters& local() {
+        thread_local PerfCounters counters;
+        return counters;
+    }
+};
@@ -0,0 +1,224 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "perf_counters.hpp"
+
+// Per-phase wall time and counters, kept for the last `window` frames. Phases
+// may be timed from several threads at once (ensemble runs), so the running
+// totals of the current frame are atomic.
+struct PhaseTimer {
+    const char*                name = nullptr;
+    std::atomic<int64_t>       current_ns{0};
+    std::vector<float>         history;         // ms per frame, ring buffer
+    std::vector<CounterValues> counter_history; // counts per frame, same ring
+    int                        head   = 0;
+    int                        filled = 0;
+
+    std::atomic<int64_t>       counters_current[num_counters] = {};
+};
+
+struct PhaseSummary {
+    const char* name;
+    float       min, mean, p99, last;
+    double      counters[num_counters]; // mean per frame, zero without counters
+
+    float ipc() const {
+        return counters[counter_cycles] > 0.0 ? counters[counter_instructions] / counters[counter_cycles] : 0.0f;
+    }
+};
+
+struct Profiler {
+    static constexpr int max_phases = 64;
+    static constexpr int window     = 240;
+
+    PhaseTimer       phases[max_phases];
+    std::atomic<int> num_phases{0};
+    std::mutex       register_mutex;
+    int              frames = 0;
+
+    static Profiler& get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // Innermost phase open on the calling thread, -1 outside any
+    static int& threadPhase() {
+        thread_local int phase = -1;
+        return phase;
+    }
+
+    int phaseId(const char* name) {
+        std::lock_guard<std::mutex> lock{register_mutex};
+        for (int i = 0; i < num_phases; i++) {
+            if (std::strcmp(phases[i].name, name) == 0) return i;
+        }
+        if (num_phases == max_phases) return max_phases - 1;
+        PhaseTimer& phase = phases[num_phases];
+        phase.name = name;
+        phase.history.assign(window, 0.0f);
+        phase.counter_history.assign(window, CounterValues{});
+        return num_phases++;
+    }
+
+    void add(int id, int64_t ns) {
+        phases[id].current_ns += ns;
+    }
+
+    void addCounters(int id, const CounterValues& delta) {
+        if (id < 0) return;
+        for (int i = 0; i < num_counters; i++) phases[id].counters_current[i] += delta.values[i];
+    }
+
+    bool hasCounters() const {
+        return PerfCounters::local().available();
+    }
+
+    // Forgets all history but keeps the registered phases
+    void reset() {
+        for (int i = 0; i < num_phases; i++) {
+            PhaseTimer& phase = phases[i];
+            phase.current_ns = 0;
+            phase.history.assign(window, 0.0f);
+            phase.counter_history.assign(window, CounterValues{});
+            phase.head = phase.filled = 0;
+            for (int c = 0; c < num_counters; c++) phase.counters_current[c] = 0;
+        }
+        frames = 0;
+    }
+
+    // Closes the frame: every phase pushes its total, zero if it did not run
+    void endFrame() {
+        for (int i = 0; i < num_phases; i++) {
+            PhaseTimer& phase = phases[i];
+            phase.history[phase.head] = phase.current_ns.exchange(0) / 1.0e6f;
+            for (int c = 0; c < num_counters; c++) phase.counter_history[phase.head].values[c] = phase.counters_current[c].exchange(0);
+            phase.head   = (phase.head + 1) % window;
+            phase.filled = std::min(phase.filled + 1, window);
+        }
+        frames++;
+    }
+
+    std::vector<PhaseSummary> summary() const {
+        std::vector<PhaseSummary> result;
+        std::vector<float>        sorted;
+        for (int i = 0; i < num_phases; i++) {
+            const PhaseTimer& phase = phases[i];
+            if (phase.filled == 0) continue;
+            sorted.assign(phase.history.begin(), phase.history.begin() + phase.filled);
+            std::sort(sorted.begin(), sorted.end());
+            float sum = 0.0f;
+            for (float ms : sorted) sum += ms;
+            const int last = (phase.head + window - 1) % window;
+            PhaseSummary s{phase.name, sorted.front(), sum / sorted.size(),
+                           sorted[(sorted.size() - 1) * 99 / 100], phase.history[last], {}};
+            // Counters average over the same window as the timings
+            for (int f = 0; f < phase.filled; f++) {
+                for (int c = 0; c < num_counters; c++) s.counters[c] += phase.counter_history[f].values[c];
+            }
+            for (int c = 0; c < num_counters; c++) s.counters[c] /= phase.filled;
+            result.push_back(s);
+        }
+        return result;
+    }
+
+    std::string overlayText() const {
+        const bool counters = hasCounters();
+        std::string text = counters ? "phase               min    mean   p99 (ms)  ipc  cache miss  branch miss\n"
+                                    : "phase               min    mean   p99 (ms)\n";
+        char line[128];
+        for (const PhaseSummary& s : summary()) {
+            if (counters) {
+                std::snprintf(line, sizeof(line), "%-18s %6.2f %6.2f %6.2f %5.2f %11.0f %12.0f\n", s.name, s.min, s.mean,
+                              s.p99, s.ipc(), s.counters[counter_cache_misses], s.counters[counter_branch_misses]);
+            } else {
+                std::snprintf(line, sizeof(line), "%-18s %6.2f %6.2f %6.2f\n", s.name, s.min, s.mean, s.p99);
+            }
+            text += line;
+        }
+        return text;
+    }
+
+    bool writeCSV(const char* path) const {
+        FILE* file = std::fopen(path, "w");
+        if (!file) return false;
+        std::fprintf(file, "phase,min_ms,mean_ms,p99_ms,last_ms");
+        for (const char* counter : counter_names) std::fprintf(file, ",%s", counter);
+        std::fprintf(file, "\n");
+        for (const PhaseSummary& s : summary()) {
+            std::fprintf(file, "%s,%.4f,%.4f,%.4f,%.4f", s.name, s.min, s.mean, s.p99, s.last);
+            for (double counter : s.counters) std::fprintf(file, ",%.0f", counter);
+            std::fprintf(file, "\n");
+        }
+        std::fclose(file);
+        return true;
+    }
+
+    bool writeJSON(const char* path) const {
+        FILE* file = std::fopen(path, "w");
+        if (!file) return false;
+        std::fprintf(file, "{\"frames\": %d, \"phases\": [", frames);
+        const std::vector<PhaseSummary> phases_summary = summary();
+        for (size_t i = 0; i < phases_summary.size(); i++) {
+            const PhaseSummary& s = phases_summary[i];
+            std::fprintf(file, "%s\n  {\"name\": \"%s\", \"min_ms\": %.4f, \"mean_ms\": %.4f, \"p99_ms\": %.4f, \"last_ms\": %.4f",
+                         i ? "," : "", s.name, s.min, s.mean, s.p99, s.last);
+            for (int c = 0; c < num_counters; c++) std::fprintf(file, ", \"%s\": %.0f", counter_names[c], s.counters[c]);
+            std::fprintf(file, "}");
+        }
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+        return true;
+    }
+};
+
+struct ScopedPhase {
+    int                                            id;
+    int                                            outer;
+    std::chrono::high_resolution_clock::time_point start;
+#ifdef PARTICLE_PERF_COUNTERS
+    CounterValues                                  counters_start;
+#endif
+
+    ScopedPhase(int id_)
+        : id{id_}
+        , outer{Profiler::threadPhase()}
+        , start{std::chrono::high_resolution_clock::now()}
+    {
+        Profiler::threadPhase() = id;
+#ifdef PARTICLE_PERF_COUNTERS
+        counters_start = PerfCounters::local().read();
+#endif
+    }
+
+    ~ScopedPhase() {
+        const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+        Profiler::get().add(id, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        Profiler::threadPhase() = outer;
+#ifdef PARTICLE_PERF_COUNTERS
+        Profiler::get().addCounters(id, PerfCounters::local().read() - counters_start);
+#endif
+    }
+};
+
+// Timers only exist when built with PARTICLE_PROFILING, otherwise the macros
+// expand to nothing. PARTICLE_PERF_COUNTERS adds hardware counters: the
+// calling thread's counts go to every open phase, a worker's counts go to the
+// innermost phase open on the thread that queued its task.
+// PARTICLE_ALLOC_TRACKING charges allocations the same way
+#ifdef PARTICLE_PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                              \
+    static const int PROFILE_CONCAT(profile_id_, __LINE__) = Profiler::get().phaseId(name); \
+    ScopedPhase PROFILE_CONCAT(profile_phase_, __LINE__){PROFILE_CONCAT(profile_id_, __LINE__)}
+#define PROFILE_FRAME() Profiler::get().endFrame()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FRAME()
+#endif
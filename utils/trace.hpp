@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent {
+    const char* label;
+    int64_t     begin_ns;
+    int64_t     end_ns;
+};
+
+// Events of one thread. Only the owning thread writes, so the ring needs no
+// lock; the dump reads it once the captured frames are over
+struct TraceBuffer {
+    static constexpr int capacity = 1 << 16;
+
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(capacity);
+    std::atomic<uint64_t>   head{0};
+    int                     tid = 0;
+
+    void push(const char* label, int64_t begin_ns, int64_t end_ns) {
+        const uint64_t slot = head.load(std::memory_order_relaxed);
+        events[slot % capacity] = {label, begin_ns, end_ns};
+        head.store(slot + 1, std::memory_order_release);
+    }
+};
+
+// Records task begin/end on every thread for a range of frames and writes
+// them as Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev)
+struct Tracer {
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::mutex                                buffers_mutex;
+    std::atomic<bool>                         recording{false};
+    int                                       frame       = 0;
+    int                                       main_tid    = -1;
+    int                                       first_frame = -1;
+    int                                       last_frame  = -1;
+    std::string                               path;
+
+    static Tracer& get() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    TraceBuffer& buffer() {
+        thread_local TraceBuffer* local = nullptr;
+        if (!local) {
+            std::lock_guard<std::mutex> lock{buffers_mutex};
+            buffers.push_back(std::make_unique<TraceBuffer>());
+            local      = buffers.back().get();
+            local->tid = buffers.size() - 1;
+        }
+        return *local;
+    }
+
+    void record(const char* label, int64_t begin_ns, int64_t end_ns) {
+        if (recording.load(std::memory_order_relaxed)) buffer().push(label, begin_ns, end_ns);
+    }
+
+    // Traces `count` frames starting `delay` frames from now, then writes them
+    void capture(int delay, int count, const std::string& path_) {
+        first_frame = frame + delay;
+        last_frame  = first_frame + count;
+        path        = path_;
+    }
+
+    // Called once per frame by the main loop
+    void nextFrame() {
+        main_tid = buffer().tid;
+        frame++;
+        if (frame == first_frame) {
+            for (auto& buffer : buffers) buffer->head = 0;
+            recording = true;
+        } else if (frame == last_frame) {
+            recording = false;
+            write(path);
+        }
+    }
+
+    bool write(const std::string& file_path) {
+        FILE* file = std::fopen(file_path.c_str(), "w");
+        if (!file) return false;
+        std::lock_guard<std::mutex> lock{buffers_mutex};
+        int64_t origin = INT64_MAX;
+        for (auto& buffer : buffers) {
+            const uint64_t head  = buffer->head.load(std::memory_order_acquire);
+            const uint64_t first = head > TraceBuffer::capacity ? head - TraceBuffer::capacity : 0;
+            if (head > first) origin = std::min(origin, buffer->events[first % TraceBuffer::capacity].begin_ns);
+        }
+
+        std::fprintf(file, "{\"traceEvents\": [");
+        bool first_event = true;
+        for (auto& buffer : buffers) {
+            std::fprintf(file, "%s\n{\"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"name\": \"thread_name\", \"args\": {\"name\": \"%s %d\"}}",
+                         first_event ? "" : ",", buffer->tid, buffer->tid == main_tid ? "main" : "thread", buffer->tid);
+            first_event = false;
+            const uint64_t head  = buffer->head.load(std::memory_order_acquire);
+            const uint64_t first = head > TraceBuffer::capacity ? head - TraceBuffer::capacity : 0;
+            for (uint64_t i = first; i < head; i++) {
+                const TraceEvent& event = buffer->events[i % TraceBuffer::capacity];
+                std::fprintf(file, ",\n{\"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"name\": \"%s\", \"ts\": %.3f, \"dur\": %.3f}",
+                             buffer->tid, event.label, (event.begin_ns - origin) / 1000.0, (event.end_ns - event.begin_ns) / 1000.0);
+            }
+        }
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+        return true;
+    }
+};
+
+// Only built with PARTICLE_TRACING, otherwise these expand to nothing
+#ifdef PARTICLE_TRACING
+#define TRACE_BEGIN(var)        const int64_t var = Tracer::get().recording ? Tracer::now() : 0
+#define TRACE_END(label, var)   if (var) Tracer::get().record(label, var, Tracer::now())
+#define TRACE_FRAME()           Tracer::get().nextFrame()
+#else
+#define TRACE_BEGIN(var)
+#define TRACE_END(label, var)
+#define TRACE_FRAME()
+#endif